@@ -18,23 +18,44 @@
 #ifndef __ROYALE_ROS_CAMERA_NODELET_H__
 #define __ROYALE_ROS_CAMERA_NODELET_H__
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include <argus_ros/Config.h>
 #include <argus_ros/Dump.h>
+#include <argus_ros/ExposureTimes.h>
 #include <argus_ros/SetExposureTime.h>
 #include <argus_ros/SetExposureTimes.h>
 #include <argus_ros/Start.h>
 #include <argus_ros/Stop.h>
+#include <argus_ros/conversion.h>
+#include <argus_ros/frame_queue.h>
+#include <argus_ros/message_pool.h>
+#include <argus_ros/normals.h>
+#include <argus_ros/scan.h>
+#include <argus_ros/spatial_filter.h>
+#include <argus_ros/temporal_filter.h>
+#include <argus_ros/voxel_grid.h>
+#include <argus_ros/worker_pool.h>
 #include <image_transport/image_transport.h>
 #include <nodelet/nodelet.h>
 #include <ros/ros.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/RegionOfInterest.h>
+#include <std_msgs/Header.h>
 #include <argus.hpp>
 
 //-------------- BNR -----------/
@@ -63,6 +84,13 @@ class CameraNodelet
     : public nodelet::Nodelet,
       public argus::IExtendedDataListener,
       public argus::IEventListener {
+ public:
+  ~CameraNodelet();
+
+  // drives the frame conversion without a camera, see
+  // test/test_convert_frame.cpp
+  friend class ConvertFrameTest;
+
  private:
   //
   // Nodelet lifecycle functions
@@ -90,6 +118,13 @@ class CameraNodelet
   // Helper funtion to load the image mask
   bool ParseMaskFile();
 
+  // Helper function to (re)publish the latched image mask
+  void PublishImageMask();
+
+  // Helper function to compile the loaded image mask for a region of interest
+  std::shared_ptr<const argus_ros::PixelMask> CompileImageMask(
+      const sensor_msgs::RegionOfInterest& roi);
+
   // Helper function to publish camera operating status
   void PublishCameraStatus();
   //------------------------------/
@@ -101,11 +136,97 @@ class CameraNodelet
   void SetExposureTimesCb(const argus_ros::SetExposureTimes::ConstPtr& msg);
 
   //
-  // Argus callback, basically functions as our main
-  // publishing loop
+  // Argus callback, queues each frame for its stream's convert thread
   //
   void onNewData(const argus::IExtendedData* data) override;
 
+  struct FrameConfig;
+
+  //
+  // A copy of the depth data of a frame, queued for the convert thread.
+  // The members mirror those of argus::DepthData, except that only the
+  // region of interest `roi` of the full_width x full_height frame is kept.
+  // `config` is the configuration the frame was cropped with, and is the
+  // one it gets converted with.
+  //
+  struct Frame {
+    std::chrono::microseconds timeStamp;
+    std::uint16_t streamId = 0;
+    std::uint16_t width = 0;
+    std::uint16_t height = 0;
+    std::uint16_t full_width = 0;
+    std::uint16_t full_height = 0;
+    sensor_msgs::RegionOfInterest roi;
+    std::vector<std::uint32_t> exposureTimes;
+    std::vector<argus::DepthPoint> points;
+    std::shared_ptr<const FrameConfig> config;
+  };
+
+  //
+  // The messages built from a frame, waiting to be published. Unwanted ones
+  // are left empty.
+  //
+  struct Products {
+    sensor_msgs::CameraInfoPtr info;
+    argus_ros::ExposureTimes::Ptr exposure;
+    sensor_msgs::ImagePtr gray;
+    sensor_msgs::ImagePtr conf;
+    sensor_msgs::ImagePtr noise;
+    sensor_msgs::ImagePtr xyz;
+    sensor_msgs::ImagePtr depth;
+    sensor_msgs::ImagePtr depth_mm;
+    sensor_msgs::PointCloud2Ptr cloud;
+    sensor_msgs::PointCloud2Ptr compact_cloud;
+    sensor_msgs::PointCloud2Ptr voxel_cloud;
+    sensor_msgs::ImagePtr normals;
+    sensor_msgs::LaserScanPtr scan;
+    sensor_msgs::CameraInfoPtr binned_info;
+    sensor_msgs::ImagePtr binned_depth;
+    sensor_msgs::PointCloud2Ptr binned_cloud;
+  };
+
+  //
+  // Per-stream pipeline: the convert thread turns queued frames into
+  // messages, the publish thread serializes and publishes them. Every stream
+  // has its own, so the streams of a mixed-mode use case do not wait on each
+  // other.
+  //
+  struct StreamWorker {
+    std::unique_ptr<argus_ros::FrameQueue<Frame> > frames;
+    std::unique_ptr<argus_ros::FrameQueue<Products> > products;
+    std::thread convert_thread;
+    std::thread publish_thread;
+  };
+
+  //
+  // The products of a frame somebody is subscribed to
+  //
+  struct Wants {
+    bool info = false;
+    bool exposure = false;
+    bool gray = false;
+    bool conf = false;
+    bool noise = false;
+    bool xyz = false;
+    bool depth = false;
+    bool depth_mm = false;
+    bool cloud = false;
+    bool compact = false;
+    bool voxel = false;
+    bool normals = false;
+    bool scan = false;
+    bool binned_info = false;
+    bool binned_depth = false;
+    bool binned_cloud = false;
+  };
+
+  void ConvertLoop(int idx, StreamWorker* worker);
+  void PublishLoop(int idx, StreamWorker* worker);
+  Wants WantedProducts(int idx) const;
+  bool ConvertFrame(int idx, const Wants& want, Frame& frame,
+                    Products& products);
+  void PublishProducts(int idx, Products& products);
+
   //-------------- BNR -----------/
   // Argus callback for events, mainly temperature events
   void onEvent(std::unique_ptr<argus::IEvent>&& event) override;
@@ -118,8 +239,129 @@ class CameraNodelet
   void RescheduleTimer();
   void CacheIntrinsics();
   void StartCameraStream();
+  void SetCurrentUseCase(const std::string& use_case);
+  void SetRoi(const sensor_msgs::RegionOfInterest& roi, FrameConfig& cfg);
+  bool PublishUnitVectors();
   int SetConfigurationParams(json&, std::string&);
 
+  //
+  // Everything `onNewData` needs to know about the current configuration.
+  // A snapshot is never modified once published; configuration changes copy
+  // the current one, modify the copy and swap it in atomically, so the SDK
+  // callback thread can read it without taking any locks.
+  //
+  struct FrameConfig {
+    std::string use_case = "UNKNOWN";
+
+    // stream id -> publisher index for the current use case, -1 (or out of
+    // range) for streams without a publisher
+    std::vector<std::int8_t> stream_index;
+
+    // REP 104 suggests publishing the intrinsics with every frame
+    // see: http://www.ros.org/reps/rep-0104.html
+    sensor_msgs::CameraInfo intrinsics;
+
+    // dimensions of the lens directions of the current use case
+    std::uint16_t uvec_width = 0;
+    std::uint16_t uvec_height = 0;
+
+    // region of interest of all published products (see `ClipRoi`), all
+    // zero for the full frame
+    sensor_msgs::RegionOfInterest roi;
+
+    // image mask compiled for `roi`, applies to frames of the mask's size
+    std::shared_ptr<const argus_ros::PixelMask> mask;
+    std::uint16_t mask_width = 0;
+    std::uint16_t mask_height = 0;
+
+    std::string optical_frame;
+    std::string sensor_frame;
+    argus_ros::CloudLayout cloud_layout = argus_ros::CloudLayout::XYZI;
+
+    // range (in meters) of the 16-bit millimeter depth image
+    float depth_mm_min = 0.f;
+    float depth_mm_max = 65.535f;
+
+    // validity gates applied by the conversion (see argus_ros::FrameInputs)
+    std::uint8_t min_confidence = 1;
+    float min_range = 0.f;
+    float max_range = std::numeric_limits<float>::infinity();
+    float max_noise = std::numeric_limits<float>::infinity();
+
+    argus_ros::SpatialParams spatial;
+    argus_ros::TemporalParams temporal;
+    argus_ros::VoxelParams voxel;
+
+    // virtual laser scan, `scan_table` is built along with the unit vectors
+    argus_ros::ScanParams scan;
+    std::shared_ptr<const argus_ros::ScanTable> scan_table;
+
+    // side length (odd, in pixels) of the normal estimation window
+    int normal_window = 7;
+
+    // bin size of the binned products, 0 when disabled
+    int bin = 0;
+    argus_ros::BinMethod bin_method = argus_ros::BinMethod::MEAN;
+  };
+
+  std::shared_ptr<const FrameConfig> GetFrameConfig() const;
+  void UpdateFrameConfig(const std::function<void(FrameConfig&)>& fn);
+
+  //
+  // Per-stream recycled outgoing messages. The conversion kernel writes
+  // straight into these. Everything in here is sized for a single resolution
+  // and is rebuilt when the resolution of the stream changes, so
+  // steady-state streaming does not allocate. Each pool retains up to
+  // `pool_size` messages, see `message_pool_size_`.
+  //
+  struct StreamBuffers {
+    explicit StreamBuffers(std::size_t pool_size) : pool_size(pool_size) {}
+
+    // messages handed out by the pools below that were not pooled
+    std::size_t PoolMisses() const;
+
+    std::size_t pool_size;
+    std::size_t reported_misses = 0;
+
+    std::uint16_t width = 0;
+    std::uint16_t height = 0;
+
+    // headers of the optical and sensor frame products
+    std_msgs::Header head;
+    std_msgs::Header cloud_head;
+
+    argus_ros::MessagePool<sensor_msgs::Image> gray_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> conf_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> noise_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> xyz_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> depth_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> depth_mm_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::PointCloud2> cloud_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::PointCloud2> compact_msgs{pool_size};
+    std::vector<std::uint32_t> compact_counts;
+    argus_ros::MessagePool<sensor_msgs::PointCloud2> voxel_msgs{pool_size};
+    argus_ros::VoxelGrid voxels;
+    argus_ros::MessagePool<sensor_msgs::Image> normals_msgs{pool_size};
+    argus_ros::NormalEstimator normals;
+    argus_ros::MessagePool<sensor_msgs::LaserScan> scan_msgs{pool_size};
+    std::vector<float> scan_bands;
+    argus_ros::MessagePool<argus_ros::ExposureTimes> exposure_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::CameraInfo> info_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::Image> binned_depth_msgs{pool_size};
+    argus_ros::MessagePool<sensor_msgs::PointCloud2> binned_cloud_msgs{
+        pool_size};
+    argus_ros::MessagePool<sensor_msgs::CameraInfo> binned_info_msgs{pool_size};
+
+    argus_ros::SpatialFilter spatial;
+
+    // depth history of the stream, dropped when the use case or the region
+    // of interest changes
+    argus_ros::TemporalFilter temporal;
+    std::string temporal_use_case;
+    std::uint32_t temporal_x_offset = 0;
+    std::uint32_t temporal_y_offset = 0;
+  };
+
   //
   // State
   //
@@ -128,12 +370,26 @@ class CameraNodelet
   bool on_;
   std::mutex on_mutex_;
 
+  // Threads used to split each frame's pixel conversion into row bands. This
+  // is declared ahead of `cam_` so that it outlives the SDK callbacks.
+  std::unique_ptr<argus_ros::WorkerPool> pool_;
+
+  // One pipeline per stream index; also declared ahead of `cam_`
+  std::vector<std::unique_ptr<StreamWorker> > workers_;
+  std::size_t queue_depth_;
+  argus_ros::DropPolicy queue_policy_;
+
+  // Messages of each product (and stream) retained for recycling, enough
+  // for every message that may be in flight
+  std::size_t message_pool_size_;
+
   std::unique_ptr<argus::ICameraDevice> cam_;
 
-  //-------------- BNR -----------/
-  // Data structure to store the unit vector data
-  std::unique_ptr<argus::DepthData> uvec_data_;
-  //------------------------------/
+  // Current per-frame configuration, only ever accessed through
+  // std::atomic_load/std::atomic_store. Writers serialize on
+  // `frame_config_mutex_`.
+  std::shared_ptr<const FrameConfig> frame_config_;
+  std::mutex frame_config_mutex_;
 
   std::mutex cam_mutex_;
   std::string access_code_;
@@ -146,8 +402,9 @@ class CameraNodelet
 
   bool instantiated_publishers_;
   std::uint32_t access_level_;
-  ros::Time last_frame_;
-  std::mutex last_frame_mutex_;
+  // Stamp of the last frame (or of the last event that should hold off the
+  // camera timeout), in nanoseconds
+  std::atomic<std::int64_t> last_frame_ns_;
 
   //-------------- BNR -----------/
   // Mutex and variable to store the time at which the last
@@ -175,6 +432,8 @@ class CameraNodelet
 
   std::unique_ptr<image_transport::ImageTransport> it_;
   std::vector<ros::Publisher> cloud_pubs_;
+  std::vector<ros::Publisher> compact_cloud_pubs_;
+  std::vector<ros::Publisher> voxel_cloud_pubs_;
   std::vector<ros::Publisher> exposure_pubs_;
   std::vector<image_transport::Publisher> noise_pubs_;
   std::vector<image_transport::Publisher> gray_pubs_;
@@ -183,22 +442,22 @@ class CameraNodelet
 
   //-------------- BNR -----------/
   std::vector<image_transport::Publisher> depth_pubs_;
+  std::vector<image_transport::Publisher> depth_mm_pubs_;
+  std::vector<image_transport::Publisher> normals_pubs_;
+  std::vector<ros::Publisher> scan_pubs_;
   std::vector<image_transport::Publisher> unit_vec_pubs_;
   ros::Publisher image_mask_pub_;
   ros::Publisher cam_hw_info_pub_;
   //------------------------------/
-  // REP 104 suggests publishing the intrinsics with every frame
-  // see: http://www.ros.org/reps/rep-0104.html
-  //
-  // So, we register each calibration message to a frame and on each stream
+  // We register each calibration message to a frame and on each stream
   // for mixed-mode use cases.
   std::vector<ros::Publisher> intrinsic_pubs_;
-  sensor_msgs::CameraInfo intrinsic_msg_;
-  std::mutex intrinsic_mutex_;
 
-  std::string current_use_case_;
-  std::mutex current_use_case_mutex_;
-  std::map<std::string, std::vector<std::uint16_t> > stream_id_lut_;
+  // binned products, only advertised when ~binning is enabled
+  std::vector<ros::Publisher> binned_info_pubs_;
+  std::vector<image_transport::Publisher> binned_depth_pubs_;
+  std::vector<ros::Publisher> binned_cloud_pubs_;
+  std::vector<std::unique_ptr<StreamBuffers> > stream_buffers_;
 
   //-------------- BNR -----------/
   std::string config_file_;
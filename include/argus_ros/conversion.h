@@ -0,0 +1,212 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_CONVERSION_H__
+#define __ARGUS_ROS_CONVERSION_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <argus.hpp>
+
+namespace argus_ros {
+/**
+ * Packed point layouts the kernel can write for the point cloud:
+ *
+ *   XYZ    - x, y, z (float32); 12 bytes per point
+ *   XYZI   - x, y, z, intensity (float32); 16 bytes per point
+ *   XYZINC - x, y, z, intensity, noise (float32), confidence (uint8);
+ *            21 bytes per point
+ */
+enum class CloudLayout { XYZ, XYZI, XYZINC };
+
+/**
+ * How the valid pixels of a bin are combined into a binned output pixel:
+ *
+ *   MEAN   - the mean of the valid points
+ *   MIN    - the valid point closest along the optical axis
+ *   MEDIAN - the valid point with the (lower) median depth
+ */
+enum class BinMethod { MEAN, MIN, MEDIAN };
+
+/** Largest supported bin size (per side) */
+const int MAX_BIN = 16;
+
+/** Size in bytes of a single point of the given layout */
+std::size_t CloudPointStep(CloudLayout layout);
+
+/**
+ * An occlusion mask compiled for the conversion kernel (see
+ * `CompilePixelMask`). Pixels are addressed in image (row-major) order.
+ *
+ *   bits        - one bit per pixel, set when the pixel is masked out; each
+ *                 row starts on a fresh 64-bit word
+ *   indices     - sorted row-major indices of the masked pixels
+ *   row_offsets - `indices[row_offsets[r] .. row_offsets[r + 1])` are the
+ *                 masked pixels of row `r`
+ *   sparse      - true when patching the few masked pixels after the fact is
+ *                 cheaper than testing every pixel against `bits`
+ */
+struct PixelMask {
+  int width = 0;
+  int height = 0;
+  std::size_t words_per_row = 0;
+  std::vector<std::uint64_t> bits;
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint32_t> row_offsets;
+  bool sparse = false;
+};
+
+/**
+ * Compiles the occlusion mask loaded from disk. That mask is stored
+ * transposed with respect to the image, i.e., the value for pixel (row, col)
+ * lives at `mask[col * stride + row]`, so it has `width` rows and `height`
+ * columns. A pixel is masked out when its value exceeds `thresh`.
+ */
+PixelMask CompilePixelMask(const float* mask, int width, int height,
+                           std::size_t stride, float thresh);
+
+/**
+ * Read-only inputs of a depth frame conversion. `mask` must match the frame
+ * dimensions; pass nullptr when no mask applies.
+ *
+ * A pixel is valid when it is not masked out, its confidence is at least
+ * `min_confidence` (which must be at least 1), its x, y and z are finite,
+ * its depth (distance along the optical axis) lies within [min_range,
+ * max_range] meters and its noise is at most `max_noise`. Invalid pixels are
+ * NaN/0 in every output.
+ */
+struct FrameInputs {
+  const argus::DepthPoint* points = nullptr;
+  int width = 0;
+  int height = 0;
+
+  const PixelMask* mask = nullptr;
+
+  std::uint8_t min_confidence = 1;
+  float min_range = 0.f;
+  float max_range = std::numeric_limits<float>::infinity();
+  float max_noise = std::numeric_limits<float>::infinity();
+};
+
+/**
+ * Whether pixel (`row`, `col`) of `in` is valid, by the same rule the
+ * conversion kernels apply. For the per-pixel passes outside of the
+ * conversion kernel (binning, normals, scan, voxels).
+ */
+inline bool IsValidPixel(const FrameInputs& in, int row, int col) {
+  const argus::DepthPoint& p = in.points[row * in.width + col];
+  if ((p.depthConfidence < std::max<std::uint8_t>(in.min_confidence, 1)) ||
+      !std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z) ||
+      !((p.z >= in.min_range) && (p.z <= in.max_range)) ||
+      !(p.noise <= in.max_noise)) {
+    return false;
+  }
+  if (in.mask) {
+    const std::uint64_t* bits =
+        in.mask->bits.data() + row * in.mask->words_per_row;
+    return !((bits[col >> 6] >> (col & 63)) & 1);
+  }
+  return true;
+}
+
+/**
+ * Destination planes of a depth frame conversion. Any plane left as nullptr
+ * is skipped. Steps are in bytes.
+ *
+ *   gray  - 16UC1 amplitude
+ *   conf  - 8UC1 depth confidence
+ *   noise - 32FC1 noise
+ *   xyz   - 32FC3 Cartesian data in the sensor frame, NaN when invalid
+ *   depth - 32FC1 distance along the optical axis in meters, 0 when invalid
+ *   depth_mm - 16UC1 (REP 118) distance along the optical axis in
+ *              millimeters, 0 when invalid or outside of
+ *              [depth_mm_min, depth_mm_max] meters. That range must lie
+ *              within [0, 65.535].
+ *   cloud - organized, packed points in the sensor frame laid out as per
+ *           `cloud_layout`; x, y, z and intensity are NaN when invalid
+ *   compact - the valid points of `cloud` only. Needs room for a full
+ *             organized cloud plus one count per row in `compact_counts`;
+ *             each row is packed in place and `CompactRows` then closes the
+ *             gaps between the rows.
+ *
+ * Binned planes are (width / bin) x (height / bin); the right-most
+ * (width % bin) columns and bottom (height % bin) rows are not binned. `bin`
+ * must lie within [2, MAX_BIN] when either is requested.
+ *
+ *   binned_depth - 32FC1 depth in meters of each bin as per `bin_method`, 0
+ *                  when no pixel of the bin is valid
+ *   binned_cloud - organized XYZI points in the sensor frame, NaN when no
+ *                  pixel of the bin is valid
+ */
+struct FrameOutputs {
+  std::uint8_t* gray = nullptr;
+  std::size_t gray_step = 0;
+  std::uint8_t* conf = nullptr;
+  std::size_t conf_step = 0;
+  std::uint8_t* noise = nullptr;
+  std::size_t noise_step = 0;
+  std::uint8_t* xyz = nullptr;
+  std::size_t xyz_step = 0;
+  std::uint8_t* depth = nullptr;
+  std::size_t depth_step = 0;
+  std::uint8_t* depth_mm = nullptr;
+  std::size_t depth_mm_step = 0;
+  float depth_mm_min = 0.f;
+  float depth_mm_max = 65.535f;
+  std::uint8_t* cloud = nullptr;
+  CloudLayout cloud_layout = CloudLayout::XYZI;
+  std::uint8_t* compact = nullptr;
+  std::uint32_t* compact_counts = nullptr;
+  int bin = 0;
+  BinMethod bin_method = BinMethod::MEAN;
+  std::uint8_t* binned_depth = nullptr;
+  std::size_t binned_depth_step = 0;
+  std::uint8_t* binned_cloud = nullptr;
+};
+
+/**
+ * Converts rows [row_begin, row_end) of a frame in a single pass, writing
+ * every requested output plane. A binned row is produced by the call that
+ * converts the last full-resolution row of its bin, right after that row,
+ * while the points of the bin are still in cache. Disjoint row ranges may be
+ * converted concurrently.
+ */
+void ConvertRows(const FrameInputs& in, const FrameOutputs& out,
+                 int row_begin, int row_end);
+
+/**
+ * Once all rows have been converted, moves the compact points of each row
+ * down behind those of the rows above it. Returns the total number of
+ * points, which now sit at the start of `out.compact`.
+ */
+std::size_t CompactRows(const FrameInputs& in, const FrameOutputs& out);
+
+/**
+ * Selects the implementation used by `ConvertRows`. When `allow_simd` is
+ * true the fastest kernel supported by the running CPU is used, otherwise
+ * the portable scalar kernel is. Returns the name of the selected kernel.
+ */
+const char* SelectConversionKernel(bool allow_simd);
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_CONVERSION_H__
@@ -0,0 +1,74 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_DEPTH_CODEC_H__
+#define __ARGUS_ROS_DEPTH_CODEC_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace argus_ros {
+/**
+ * Lossless codecs used by the "lossless" image_transport plugin.
+ *
+ * RVL (run length / variable length coding, A. D. Wilson, "Fast Lossless
+ * Depth Image Compression", ISS 2017) is meant for 16-bit depth images: runs
+ * of zero (invalid) pixels are run-length coded and the deltas between
+ * neighbouring valid pixels are zig-zag coded into 3-bit nibble groups. It is
+ * a single, branch-light pass over the image.
+ *
+ * Float and multi-byte images do not have small deltas in their raw bytes, so
+ * those are byte-shuffled first (byte `k` of every element goes into plane
+ * `k`), which lines up the slowly changing sign/exponent bytes into long runs
+ * that LZ4 compresses well, and then handed to LZ4.
+ *
+ * The decoders treat their input as untrusted and return false instead of
+ * reading or writing out of bounds.
+ */
+
+/** Replaces `out` with the RVL encoding of the `n` pixels at `in` */
+void EncodeRVL(const std::uint16_t* in, std::size_t n,
+               std::vector<std::uint8_t>& out);
+
+/**
+ * Decodes exactly `n` pixels of RVL data into `out`. Fails unless the `len`
+ * bytes at `in` hold exactly `n` pixels.
+ */
+bool DecodeRVL(const std::uint8_t* in, std::size_t len, std::uint16_t* out,
+               std::size_t n);
+
+/**
+ * Replaces `out` with the shuffled and LZ4 compressed `n` elements of
+ * `elem_size` bytes at `in`. `scratch` holds the shuffled bytes and is kept
+ * by the caller so steady-state encoding does not allocate.
+ */
+void EncodeShuffleLZ4(const std::uint8_t* in, std::size_t n,
+                      std::size_t elem_size, std::vector<std::uint8_t>& out,
+                      std::vector<std::uint8_t>& scratch);
+
+/**
+ * Decodes exactly `n` elements of `elem_size` bytes into `out`. Fails unless
+ * the `len` bytes at `in` hold exactly that many.
+ */
+bool DecodeShuffleLZ4(const std::uint8_t* in, std::size_t len,
+                      std::uint8_t* out, std::size_t n, std::size_t elem_size,
+                      std::vector<std::uint8_t>& scratch);
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_DEPTH_CODEC_H__
@@ -0,0 +1,208 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_FRAME_QUEUE_H__
+#define __ARGUS_ROS_FRAME_QUEUE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace argus_ros {
+/**
+ * What a full `FrameQueue` does with a new frame:
+ *
+ *   OLDEST - recycles the oldest queued frame for it
+ *   NEWEST - drops the new frame
+ *   BLOCK  - makes the producer wait for the consumer
+ */
+enum class DropPolicy { OLDEST, NEWEST, BLOCK };
+
+/**
+ * Parses "drop_oldest", "drop_newest" or "block". Returns false (and leaves
+ * `policy` untouched) for anything else.
+ */
+inline bool ParseDropPolicy(const std::string& name, DropPolicy& policy) {
+  if (name == "drop_oldest") {
+    policy = DropPolicy::OLDEST;
+  } else if (name == "drop_newest") {
+    policy = DropPolicy::NEWEST;
+  } else if (name == "block") {
+    policy = DropPolicy::BLOCK;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * A bounded single-producer/single-consumer queue of preallocated frames.
+ *
+ * The producer borrows a free slot with `Acquire()`, fills it and hands it
+ * over with `Push()`. The consumer takes the oldest queued slot with `Pop()`
+ * and gives it back with `Release()` once done. Slots (and whatever capacity
+ * their members have grown to) are recycled, so a steady stream of
+ * same-sized frames does not allocate. The internal lock only covers
+ * handing slot pointers around, never the filling or processing of a frame.
+ */
+template <typename T>
+class FrameQueue {
+ public:
+  /**
+   * `depth` (at least 1) is the number of frames that may wait for the
+   * consumer. One more slot each is reserved for the producer and the
+   * consumer.
+   */
+  FrameQueue(std::size_t depth, DropPolicy policy)
+      : depth_(std::max<std::size_t>(depth, 1)),
+        policy_(policy),
+        slots_(depth_ + 2),
+        ready_(depth_),
+        ready_head_(0),
+        ready_count_(0),
+        closed_(false),
+        dropped_(0) {
+    for (auto& slot : this->slots_) {
+      this->free_.push_back(&slot);
+    }
+  }
+
+  FrameQueue(const FrameQueue&) = delete;
+  FrameQueue& operator=(const FrameQueue&) = delete;
+
+  /**
+   * Returns a slot to fill, or nullptr if the frame has to be dropped (as
+   * per the drop policy) or the queue is closed.
+   */
+  T* Acquire() {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    if (this->policy_ == DropPolicy::BLOCK) {
+      this->free_cv_.wait(lock, [this] {
+        return this->closed_ || (this->ready_count_ < this->depth_);
+      });
+    }
+
+    if (this->closed_) {
+      return nullptr;
+    }
+
+    // with at most `depth_` frames queued there is always a free slot
+    if (this->ready_count_ >= this->depth_) {
+      this->dropped_++;
+      if (this->policy_ == DropPolicy::NEWEST) {
+        return nullptr;
+      }
+      return this->PopReady();
+    }
+
+    T* slot = this->free_.back();
+    this->free_.pop_back();
+    return slot;
+  }
+
+  /** Queues a slot obtained from `Acquire()` for the consumer */
+  void Push(T* slot) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->ready_[(this->ready_head_ + this->ready_count_) % this->depth_] =
+          slot;
+      this->ready_count_++;
+    }
+    this->ready_cv_.notify_one();
+  }
+
+  /**
+   * Waits for and returns the oldest queued slot. Returns nullptr once the
+   * queue is closed.
+   */
+  T* Pop() {
+    T* slot = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->ready_cv_.wait(lock, [this] {
+        return this->closed_ || (this->ready_count_ > 0);
+      });
+
+      if (this->closed_) {
+        return nullptr;
+      }
+
+      slot = this->PopReady();
+    }
+    this->free_cv_.notify_one();
+    return slot;
+  }
+
+  /**
+   * Gives a slot obtained from `Pop()` (or an unused one obtained from
+   * `Acquire()`) back to the producer
+   */
+  void Release(T* slot) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->free_.push_back(slot);
+    }
+    this->free_cv_.notify_one();
+  }
+
+  /** Wakes up and turns away both sides for good */
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->closed_ = true;
+    }
+    this->ready_cv_.notify_all();
+    this->free_cv_.notify_all();
+  }
+
+  /** Number of frames dropped so far */
+  std::uint64_t Dropped() const { return this->dropped_.load(); }
+
+ private:
+  // expects `mutex_` to be held and at least one frame queued
+  T* PopReady() {
+    T* slot = this->ready_[this->ready_head_];
+    this->ready_head_ = (this->ready_head_ + 1) % this->depth_;
+    this->ready_count_--;
+    return slot;
+  }
+
+  std::size_t depth_;
+  DropPolicy policy_;
+  std::vector<T> slots_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  std::condition_variable free_cv_;
+  std::vector<T*> free_;
+
+  // ring of queued frames, oldest first
+  std::vector<T*> ready_;
+  std::size_t ready_head_;
+  std::size_t ready_count_;
+  bool closed_;
+  std::atomic<std::uint64_t> dropped_;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_FRAME_QUEUE_H__
@@ -0,0 +1,69 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_LOSSLESS_TRANSPORT_H__
+#define __ARGUS_ROS_LOSSLESS_TRANSPORT_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <argus_ros/LosslessImage.h>
+#include <image_transport/simple_publisher_plugin.h>
+#include <image_transport/simple_subscriber_plugin.h>
+#include <sensor_msgs/Image.h>
+
+namespace argus_ros {
+/**
+ * Publisher side of the "lossless" image_transport. 16-bit single channel
+ * images (e.g., `depth_image_mm`) are RVL coded, everything else (e.g., the
+ * float `depth_image` and `xyz` images) is byte-shuffled and LZ4
+ * compressed. See argus_ros/depth_codec.h.
+ */
+class LosslessPublisher
+    : public image_transport::SimplePublisherPlugin<argus_ros::LosslessImage> {
+ public:
+  std::string getTransportName() const override { return "lossless"; }
+
+ protected:
+  void publish(const sensor_msgs::Image& message,
+               const PublishFn& publish_fn) const override;
+
+ private:
+  // shuffle buffer, reused across frames
+  mutable std::mutex mutex_;
+  mutable std::vector<std::uint8_t> scratch_;
+};
+
+/** Subscriber side of the "lossless" image_transport */
+class LosslessSubscriber
+    : public image_transport::SimpleSubscriberPlugin<argus_ros::LosslessImage> {
+ public:
+  std::string getTransportName() const override { return "lossless"; }
+
+ protected:
+  void internalCallback(const argus_ros::LosslessImage::ConstPtr& message,
+                        const Callback& user_cb) override;
+
+ private:
+  std::vector<std::uint8_t> scratch_;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_LOSSLESS_TRANSPORT_H__
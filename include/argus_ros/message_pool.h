@@ -0,0 +1,101 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_MESSAGE_POOL_H__
+#define __ARGUS_ROS_MESSAGE_POOL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace argus_ros {
+/**
+ * A recycling pool of messages (or any other buffers handed out by
+ * boost::shared_ptr).
+ *
+ * The pool keeps one reference to each message it has ever handed out. A
+ * message is considered free again once the pool's reference is the only
+ * one left, i.e., once the publisher queues, intra-process subscribers and
+ * anybody else have dropped theirs. Recycling a message this way needs no
+ * custom deleter, so once the pool has grown to the number of messages in
+ * flight, `Acquire()` performs no heap allocations at all. Containers in a
+ * recycled message keep their capacity, so refilling a message of the same
+ * resolution does not allocate either.
+ *
+ * `Acquire()` must only be called from one thread at a time; releasing
+ * references may happen from any thread.
+ */
+template <typename T>
+class MessagePool {
+ public:
+  typedef boost::shared_ptr<T> Ptr;
+
+  /**
+   * `max_size` bounds the number of messages retained by the pool. Once that
+   * many are in flight, further requests get a fresh, unpooled message (see
+   * `Misses()`).
+   */
+  explicit MessagePool(std::size_t max_size) : max_size_(max_size) {
+    this->slots_.reserve(max_size);
+  }
+
+  /**
+   * Returns a message that is not referenced outside of the pool. Its
+   * contents are whatever its previous user left in it.
+   */
+  Ptr Acquire() {
+    for (auto& slot : this->slots_) {
+      if (slot.use_count() == 1) {
+        // pairs with the release performed when the last user let go
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot;
+      }
+    }
+
+    if (this->slots_.size() < this->max_size_) {
+      this->slots_.push_back(boost::make_shared<T>());
+      return this->slots_.back();
+    }
+
+    ++this->misses_;
+    return boost::make_shared<T>();
+  }
+
+  /** Number of messages currently retained by the pool */
+  std::size_t Size() const { return this->slots_.size(); }
+
+  /**
+   * Number of times `Acquire()` found all `max_size` messages in flight and
+   * had to allocate an unpooled one
+   */
+  std::size_t Misses() const { return this->misses_; }
+
+  /** Drops the pool's references, e.g., when the stream resolution changes */
+  void Clear() { this->slots_.clear(); }
+
+ private:
+  std::vector<Ptr> slots_;
+  std::size_t max_size_;
+  std::size_t misses_ = 0;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_MESSAGE_POOL_H__
@@ -0,0 +1,83 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_NORMALS_H__
+#define __ARGUS_ROS_NORMALS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <argus_ros/conversion.h>
+
+namespace argus_ros {
+/**
+ * Surface normals of an organized frame, estimated from integral images.
+ *
+ * `Integrate()` builds summed-area tables of the valid points (in the sensor
+ * frame, like the cloud) and of their pairwise coordinate products. After
+ * that the covariance of the points in any window takes four lookups, so the
+ * cost per pixel is the same for every window size. The normal is the
+ * eigenvector of the window's covariance with the smallest eigenvalue,
+ * turned towards the sensor, and the curvature is that eigenvalue over the
+ * sum of all three (as in PCL's surface variation).
+ *
+ * A pixel gets a normal if it is valid itself (see argus_ros::FrameInputs)
+ * and its window holds at least three valid points that are not all on a
+ * line. The window does not stop at depth edges, so normals right at an edge
+ * blend both sides.
+ */
+class NormalEstimator {
+ public:
+  /** Builds the tables for frame `in`; the frame must outlive `Rows` calls */
+  void Integrate(const argus_ros::FrameInputs& in);
+
+  /**
+   * `Integrate` in parallel passes: `Prepare`, then `IntegrateRows` over all
+   * rows, then `IntegrateColumns` over all columns. The bands of one pass may
+   * be computed concurrently, the passes must follow each other.
+   */
+  void Prepare(const argus_ros::FrameInputs& in);
+  void IntegrateRows(const argus_ros::FrameInputs& in, int row_begin,
+                     int row_end);
+  void IntegrateColumns(int col_begin, int col_end);
+
+  /**
+   * Writes rows [row_begin, row_end) of the normals into `out`, a 32FC4
+   * image (normal x, y, z and curvature; NaN where there is no normal) with
+   * `step` bytes per row. `window` is the (odd) side length of the window in
+   * pixels. Rows may be computed concurrently once `Integrate` returned.
+   */
+  void Rows(const argus_ros::FrameInputs& in, int window, int row_begin,
+            int row_end, std::uint8_t* out, std::size_t step) const;
+
+ private:
+  // running sums of the count, the coordinates and their products
+  struct Moments {
+    double n, x, y, z, xx, xy, xz, yy, yz, zz;
+  };
+
+  // (height + 1) x (width + 1) summed-area table, first row/column zero;
+  // holds the sums along each row between the two passes
+  std::vector<Moments> table_;
+  int width_ = 0;
+  int height_ = 0;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_NORMALS_H__
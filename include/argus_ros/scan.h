@@ -0,0 +1,97 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_SCAN_H__
+#define __ARGUS_ROS_SCAN_H__
+
+#include <cstdint>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+
+namespace argus_ros {
+/**
+ * Settings of the virtual laser scan. All are in the sensor frame (x
+ * forward, y left, z up), in meters and radians.
+ *
+ *   min_height/max_height - band of heights (z) whose points make the scan
+ *   angle_increment       - angular resolution of the scan
+ *   range_min/range_max   - planar ranges outside of these are dropped
+ */
+struct ScanParams {
+  float min_height = -0.05f;
+  float max_height = 0.05f;
+  float angle_increment = 0.005f;
+  float range_min = 0.1f;
+  float range_max = 10.f;
+};
+
+/**
+ * The angle bin of every pixel, derived from the lens directions (unit
+ * vectors) of a use case. The ToF optics are not a pinhole, so the bins are
+ * kept per pixel rather than per column; building them takes one atan2 per
+ * pixel, which is paid once per use case instead of with every frame.
+ *
+ * `bins` is row-major `width` x `height`; -1 marks pixels without a usable
+ * lens direction. Bin `i` is centered on `angle_min + i * angle_increment`.
+ */
+struct ScanTable {
+  int width = 0;
+  int height = 0;
+  std::vector<std::int32_t> bins;
+  float angle_min = 0.f;
+  float angle_increment = 0.f;
+  int nbins = 0;
+};
+
+/**
+ * Builds the table for the `width` x `height` region of the lens directions
+ * starting at column `x_offset` and row `y_offset`. `stride` is the number
+ * of unit vectors per row of `uvec`.
+ */
+ScanTable BuildScanTable(const argus::DepthPoint* uvec, int stride,
+                         int x_offset, int y_offset, int width, int height,
+                         const ScanParams& params);
+
+/**
+ * Fills `ranges` (`table.nbins` values) with the closest planar range of the
+ * valid points of `in` within the height band of `params`, +inf for bins
+ * without such a point (REP 117). `in` must match the table's dimensions.
+ */
+void ProjectScan(const FrameInputs& in, const ScanTable& table,
+                 const ScanParams& params, float* ranges);
+
+/**
+ * The banded form of ProjectScan: fills `sq` (`table.nbins` values) with the
+ * closest squared planar range of the points in rows [row_begin, row_end),
+ * +inf where there is none. Bands writing to separate `sq` may run
+ * concurrently.
+ */
+void ScanRows(const FrameInputs& in, const ScanTable& table,
+              const ScanParams& params, int row_begin, int row_end,
+              float* sq);
+
+/**
+ * Reduces the `nbands` outputs of ScanRows, stored `nbins` apart from `sq`
+ * on, to the `nbins` ranges of the scan. `ranges` may alias `sq`.
+ */
+void MergeScan(const float* sq, int nbands, int nbins, float* ranges);
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_SCAN_H__
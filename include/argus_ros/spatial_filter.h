@@ -0,0 +1,87 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_SPATIAL_FILTER_H__
+#define __ARGUS_ROS_SPATIAL_FILTER_H__
+
+#include <cstddef>
+#include <vector>
+
+#include <argus.hpp>
+
+namespace argus_ros {
+/** Most passes the spatial filter supports */
+const int MAX_SPATIAL_ITERATIONS = 5;
+
+/**
+ * Settings of the spatial filter.
+ *
+ *   iterations - number of horizontal + vertical passes, 0 turns the filter
+ *                off
+ *   sigma_s    - spatial extent of the smoothing, in pixels
+ *   sigma_r    - depth difference (meters) across which smoothing falls off,
+ *                i.e., how strongly edges are preserved
+ */
+struct SpatialParams {
+  int iterations = 0;
+  float sigma_s = 4.f;
+  float sigma_r = 0.05f;
+};
+
+/**
+ * Edge-preserving depth smoother, run on a frame before it is converted.
+ *
+ * This is the recursive filter of the domain transform (E. Gastal and M.
+ * Oliveira, "Domain Transform for Edge-Aware Image and Video Processing",
+ * SIGGRAPH 2011): each iteration runs a first-order recursive filter left to
+ * right and back along the rows, then top to bottom and back along the
+ * columns. The feedback between two neighbours shrinks with their depth
+ * difference, so smoothing stops at depth edges. It is applied as a
+ * normalized convolution, with each pixel weighted by its confidence over
+ * its noise variance; noisy and low-confidence pixels borrow from their
+ * neighbours more than they lend to them. The cost per pixel does not depend
+ * on `sigma_s`.
+ *
+ * Invalid pixels (zero confidence, or a depth that is not positive and
+ * finite) are left alone and cut the smoothing like an edge. As in the
+ * temporal filter, x and y are scaled along with the depth. The recursion
+ * runs on four rows (or columns) at once, one per vector lane; the rows are
+ * transposed in 4x4 tiles for that. Once sized, filtering does not allocate.
+ */
+class SpatialFilter {
+ public:
+  /** Filters the `width` x `height` row-major `points` in place */
+  void Apply(const SpatialParams& params, argus::DepthPoint* points,
+             int width, int height);
+
+ private:
+  // planes of `storage_`, each `rows_` rows of `stride_` floats, all padding
+  // zero
+  enum { DEPTH, NUM, DEN, COEF_H, COEF_V, NPLANES };
+  float* Plane(int i) { return this->storage_.data() + i * this->size_; }
+
+  int width_ = 0;
+  int height_ = 0;
+  std::size_t stride_ = 0;  // floats per row, a multiple of 4
+  std::size_t rows_ = 0;    // rows per plane, a multiple of 4
+  std::size_t size_ = 0;    // floats per plane
+  std::vector<float> storage_;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_SPATIAL_FILTER_H__
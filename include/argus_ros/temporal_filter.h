@@ -0,0 +1,114 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_TEMPORAL_FILTER_H__
+#define __ARGUS_ROS_TEMPORAL_FILTER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+
+namespace argus_ros {
+/**
+ * How the temporal filter combines a pixel's depth history:
+ *
+ *   NONE     - the filter is off
+ *   EMA      - exponential moving average, weighting the newest depth by
+ *              `alpha`
+ *   MEDIAN   - (lower) median of the valid depths in the history window
+ *   WEIGHTED - mean of the valid depths in the history window, each weighted
+ *              by its confidence
+ */
+enum class TemporalMode { NONE, EMA, MEDIAN, WEIGHTED };
+
+/** Longest supported history window, in frames */
+const int MAX_HISTORY = 8;
+
+/**
+ * Settings of the temporal filter.
+ *
+ *   history         - window of the MEDIAN and WEIGHTED modes, in frames
+ *   alpha           - weight of the newest depth in EMA mode, in (0, 1]
+ *   max_jump        - a pixel whose depth moves further than this (meters)
+ *                     from its filtered value drops its history
+ *   motion_fraction - when more than this fraction of the pixels jump, the
+ *                     scene (or the camera) moved and the whole history is
+ *                     dropped
+ */
+struct TemporalParams {
+  TemporalMode mode = TemporalMode::NONE;
+  int history = 4;
+  float alpha = 0.3f;
+  float max_jump = 0.1f;
+  float motion_fraction = 0.3f;
+};
+
+/**
+ * Per-stream temporal depth denoiser, run on a frame before it is converted.
+ *
+ * It keeps the depth and confidence of the last `history` frames in a ring of
+ * planes (one 64-byte aligned plane per frame and quantity) and works through
+ * them four pixels at a time. Only the depth of valid pixels (see
+ * `FrameInputs`) in front of the camera changes; x and y are scaled along, so
+ * filtered points stay on their pixel's ray. Invalid pixels are left as they
+ * are and stay out of the history, the filter does not fill holes.
+ *
+ * The history is dropped by `Reset()`, when the frame size or the settings
+ * change, and when a frame moves too many pixels (see `TemporalParams`).
+ * Once sized, filtering does not allocate.
+ */
+class TemporalFilter {
+ public:
+  /**
+   * Filters `points` in place. `in` describes the same frame and holds the
+   * gates and mask that decide which pixels are valid.
+   */
+  void Apply(const TemporalParams& params, const FrameInputs& in,
+             argus::DepthPoint* points);
+
+  /** Forgets all history; the next frame passes through unchanged */
+  void Reset();
+
+ private:
+  // plane `i` of `storage_`: the depth (0 when invalid) ring in
+  // [0, slots_), the confidence ring in [slots_, 2 * slots_), then the last
+  // filtered depth of each pixel (0 when none) and the first frame of each
+  // pixel's current history (int32)
+  float* Plane(int i) {
+    return this->storage_.data() + this->offset_ + i * this->stride_;
+  }
+
+  TemporalParams params_;
+  int width_ = 0;
+  int height_ = 0;
+  int slots_ = 0;
+  std::size_t stride_ = 0;  // floats per plane, a multiple of 16
+  std::size_t offset_ = 0;  // floats up to the first 64-byte boundary
+  std::vector<float> storage_;
+
+  // number of the frame held by each ring slot
+  std::int32_t slot_frame_[MAX_HISTORY] = {};
+  std::int32_t frame_ = 0;  // number of the frame being filtered
+  std::int32_t epoch_ = 0;  // frames before this one are forgotten
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_TEMPORAL_FILTER_H__
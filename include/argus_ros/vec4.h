@@ -0,0 +1,84 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_VEC4_H__
+#define __ARGUS_ROS_VEC4_H__
+
+#include <cstdint>
+#include <cstring>
+
+namespace argus_ros {
+/**
+ * Four lanes of GCC/Clang generic vectors, used by the depth filters.
+ *
+ * Unlike the conversion kernel, which needs SSE4.1 blends and so has
+ * separate SSE4.1, NEON and scalar variants, the filters only need lane-wise
+ * arithmetic, compares (yielding all-ones/all-zero V4i lanes) and selects
+ * (`mask ? a : b`). The compiler maps those to SSE2 on x86-64 and to NEON on
+ * ARM from the same code.
+ */
+namespace vec4 {
+
+typedef float V4f __attribute__((vector_size(16)));
+typedef std::int32_t V4i __attribute__((vector_size(16)));
+
+inline V4f Splat(float x) { return V4f{x, x, x, x}; }
+inline V4i Splat(std::int32_t x) { return V4i{x, x, x, x}; }
+
+/** Unaligned load/store; int32 lanes may live in float storage */
+template <typename V>
+inline V Load(const float* p) {
+  V v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <typename V>
+inline void Store(float* p, const V& v) {
+  std::memcpy(p, &v, sizeof(v));
+}
+
+inline V4f Min(V4f a, V4f b) { return a < b ? a : b; }
+inline V4f Max(V4f a, V4f b) { return a < b ? b : a; }
+inline V4i Max(V4i a, V4i b) { return a < b ? b : a; }
+
+#if defined(__clang__)
+#define ARGUS_ROS_SHUFFLE4(a, b, i, j, k, l) \
+  __builtin_shufflevector(a, b, i, j, k, l)
+#else
+#define ARGUS_ROS_SHUFFLE4(a, b, i, j, k, l) \
+  __builtin_shuffle(a, b, V4i{i, j, k, l})
+#endif
+
+/** Transposes the 4x4 matrix whose rows are `a`, `b`, `c` and `d` */
+inline void Transpose(V4f& a, V4f& b, V4f& c, V4f& d) {
+  V4f t0 = ARGUS_ROS_SHUFFLE4(a, b, 0, 4, 1, 5);
+  V4f t1 = ARGUS_ROS_SHUFFLE4(a, b, 2, 6, 3, 7);
+  V4f t2 = ARGUS_ROS_SHUFFLE4(c, d, 0, 4, 1, 5);
+  V4f t3 = ARGUS_ROS_SHUFFLE4(c, d, 2, 6, 3, 7);
+  a = ARGUS_ROS_SHUFFLE4(t0, t2, 0, 1, 4, 5);
+  b = ARGUS_ROS_SHUFFLE4(t0, t2, 2, 3, 6, 7);
+  c = ARGUS_ROS_SHUFFLE4(t1, t3, 0, 1, 4, 5);
+  d = ARGUS_ROS_SHUFFLE4(t1, t3, 2, 3, 6, 7);
+}
+
+#undef ARGUS_ROS_SHUFFLE4
+
+}  // end: namespace vec4
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_VEC4_H__
@@ -0,0 +1,88 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_VOXEL_GRID_H__
+#define __ARGUS_ROS_VOXEL_GRID_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <argus_ros/conversion.h>
+
+namespace argus_ros {
+/**
+ * Which point stands for a voxel:
+ *
+ *   CENTROID      - the mean of the voxel's points (and of their intensities)
+ *   NEAREST       - the point closest to the center of the voxel
+ *   MAX_INTENSITY - the point with the highest intensity
+ */
+enum class VoxelReduction { CENTROID, NEAREST, MAX_INTENSITY };
+
+/**
+ * Settings of the voxel grid.
+ *
+ *   leaf_size - edge length of the (cubic) voxels in meters
+ *   reduction - see argus_ros::VoxelReduction
+ */
+struct VoxelParams {
+  float leaf_size = 0.05f;
+  VoxelReduction reduction = VoxelReduction::CENTROID;
+};
+
+/**
+ * Voxel grid downsampling of the valid points of a frame (see
+ * argus_ros::FrameInputs), in the sensor frame like the cloud.
+ *
+ * Points are binned in a single pass through an open-addressing (linear
+ * probing) hash table keyed on the packed voxel coordinates, so the cost is
+ * linear in the number of pixels, with no sort as in PCL's VoxelGrid. The
+ * table and the per-voxel accumulators are sized for the frame and kept
+ * between calls; only the slots used by a frame are cleared afterwards, so
+ * a steady stream of frames does not allocate.
+ *
+ * Voxels come out in the order their first point was seen, i.e., row-major.
+ * Points more than about 2^20 leaves from the sensor are dropped.
+ */
+class VoxelGrid {
+ public:
+  /**
+   * Writes one XYZI point (four float32, see argus_ros::CloudLayout) per
+   * occupied voxel to `out`, which must have room for one point per pixel of
+   * `in`. Returns the number of points written.
+   */
+  std::size_t Reduce(const argus_ros::FrameInputs& in,
+                     const argus_ros::VoxelParams& params, std::uint8_t* out);
+
+ private:
+  struct Voxel {
+    float x, y, z, intensity;
+    // count for the centroid, otherwise the score of the kept point
+    float score;
+    std::uint32_t slot;
+  };
+
+  // power of two number of slots; `keys_` holds EMPTY in unused ones
+  std::vector<std::uint64_t> keys_;
+  std::vector<std::uint32_t> index_;
+  std::vector<Voxel> voxels_;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_VOXEL_GRID_H__
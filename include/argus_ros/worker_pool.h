@@ -0,0 +1,83 @@
+// -*- c++ -*-
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARGUS_ROS_WORKER_POOL_H__
+#define __ARGUS_ROS_WORKER_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace argus_ros {
+/**
+ * A small, persistent pool of threads used to split the per-frame pixel work
+ * into row bands. The calling thread always participates in the work, so a
+ * pool of zero workers simply runs everything inline.
+ */
+class WorkerPool {
+ public:
+  /**
+   * Spawns `nworkers` threads. When `cpus` is non-empty, worker `i` is pinned
+   * to core `cpus[i % cpus.size()]`.
+   */
+  WorkerPool(std::size_t nworkers, const std::vector<int>& cpus);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  /**
+   * Splits the rows [0, nrows) into contiguous bands, one per participating
+   * thread, and calls `fn(row_begin, row_end)` for each. Returns once every
+   * band has been processed. If another thread is already using the pool,
+   * the bands are processed inline on the calling thread instead of waiting.
+   * Any other range of indices, e.g. columns, can be split the same way.
+   */
+  void ForEachBand(int nrows, const std::function<void(int, int)>& fn);
+
+  /** Number of worker threads (not counting the caller) */
+  std::size_t Size() const { return this->threads_.size(); }
+
+ private:
+  void Run();
+  void RunBands();
+
+  std::vector<std::thread> threads_;
+
+  // serializes callers of ForEachBand
+  std::mutex call_mutex_;
+
+  // guards the job description below
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int, int)>* job_;
+  int nrows_;
+  int nbands_;
+  std::atomic<int> next_band_;
+  std::size_t busy_;
+  std::uint64_t generation_;
+  bool stop_;
+};
+
+}  // end: namespace argus_ros
+
+#endif  // __ARGUS_ROS_WORKER_POOL_H__
@@ -15,6 +15,7 @@
  */
 
 #include <argus_ros/camera_nodelet.h>
+#include <argus_ros/conversion.h>
 
 #include <algorithm>
 #include <cctype>
@@ -41,12 +42,14 @@
 #include <cv_bridge/cv_bridge.h>
 #include <image_transport/image_transport.h>
 #include <nodelet/nodelet.h>
-#include <pcl_conversions/pcl_conversions.h>
-#include <pcl_ros/point_cloud.h>
 #include <pluginlib/class_list_macros.h>
 #include <ros/ros.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+#include <sensor_msgs/RegionOfInterest.h>
 #include <sensor_msgs/image_encodings.h>
 #include <argus.hpp>
 #include <boost/algorithm/string.hpp>
@@ -64,10 +67,125 @@ typedef argus_ros::StopRecord::Request StopRecReq;
 typedef argus_ros::StopRecord::Response StopRecResp;
 //------------------------------/
 
+namespace {
+// queue size of the per-frame publishers
+const std::uint32_t PUBLISHER_QUEUE_SIZE = 1;
+
+//
+// Hands out a recycled image message sized for a `width` x `height` frame
+// of `encoding`, for the conversion kernel to write its pixels straight
+// into. Refilling a message of the same size reuses its storage (including
+// the header strings), so this does not touch the heap in steady state.
+//
+sensor_msgs::ImagePtr PrepareImage(
+    const std_msgs::Header& head, const std::string& encoding,
+    std::uint32_t width, std::uint32_t height, std::uint32_t pixel_bytes,
+    argus_ros::MessagePool<sensor_msgs::Image>& pool) {
+  sensor_msgs::ImagePtr msg = pool.Acquire();
+  msg->header = head;
+  msg->height = height;
+  msg->width = width;
+  msg->encoding = encoding;
+  msg->is_bigendian = false;
+  msg->step = width * pixel_bytes;
+  msg->data.resize(msg->step * height);
+  return msg;
+}
+
+//
+// Same as `PrepareImage` but for a point cloud, whose fields are packed as
+// per `layout` (see argus_ros::CloudLayout)
+//
+sensor_msgs::PointCloud2Ptr PrepareCloud(
+    const std_msgs::Header& head, std::uint32_t width, std::uint32_t height,
+    argus_ros::CloudLayout layout, bool is_dense,
+    argus_ros::MessagePool<sensor_msgs::PointCloud2>& pool) {
+  static const char* names[] = {"x", "y", "z", "intensity", "noise",
+                                "confidence"};
+
+  std::size_t nfields = 6;
+  if (layout == argus_ros::CloudLayout::XYZ) {
+    nfields = 3;
+  } else if (layout == argus_ros::CloudLayout::XYZI) {
+    nfields = 4;
+  }
+
+  sensor_msgs::PointCloud2Ptr msg = pool.Acquire();
+  msg->header = head;
+  msg->height = height;
+  msg->width = width;
+  msg->fields.resize(nfields);
+  for (std::size_t i = 0; i < nfields; ++i) {
+    msg->fields[i].name = names[i];
+    msg->fields[i].offset = i * sizeof(float);
+    msg->fields[i].datatype = (i == 5) ? sensor_msgs::PointField::UINT8 :
+                                         sensor_msgs::PointField::FLOAT32;
+    msg->fields[i].count = 1;
+  }
+  msg->is_bigendian = false;
+  msg->point_step = argus_ros::CloudPointStep(layout);
+  msg->row_step = msg->point_step * width;
+  msg->data.resize(msg->row_step * height);
+  msg->is_dense = is_dense;
+  return msg;
+}
+
+//
+// Clips a region of interest to a `width` x `height` frame. A zero width or
+// height extends the region to the edge of the frame; a region starting
+// outside of the frame selects the whole frame.
+//
+sensor_msgs::RegionOfInterest ClipRoi(const sensor_msgs::RegionOfInterest& roi,
+                                      std::uint32_t width,
+                                      std::uint32_t height) {
+  sensor_msgs::RegionOfInterest out;
+  if ((roi.x_offset >= width) || (roi.y_offset >= height)) {
+    out.width = width;
+    out.height = height;
+    return out;
+  }
+
+  out.x_offset = roi.x_offset;
+  out.y_offset = roi.y_offset;
+  out.width = width - roi.x_offset;
+  out.height = height - roi.y_offset;
+  if (roi.width > 0) {
+    out.width = std::min(roi.width, out.width);
+  }
+  if (roi.height > 0) {
+    out.height = std::min(roi.height, out.height);
+  }
+  return out;
+}
+
+//
+// The values of the JSON configuration are strings, but plain numbers are
+// accepted for the driver settings too
+//
+int JsonToInt(const json& j) {
+  return j.is_string() ? std::stoi(j.get<std::string>()) : j.get<int>();
+}
+
+float JsonToFloat(const json& j) {
+  return j.is_string() ? std::stof(j.get<std::string>()) : j.get<float>();
+}
+}  // end: anonymous namespace
+
 //================================================
 // Nodelet implementation
 //================================================
 
+argus_ros::CameraNodelet::~CameraNodelet() {
+  for (auto& worker : this->workers_) {
+    worker->frames->Close();
+    worker->products->Close();
+  }
+  for (auto& worker : this->workers_) {
+    worker->convert_thread.join();
+    worker->publish_thread.join();
+  }
+}
+
 void argus_ros::CameraNodelet::onInit() {
   NODELET_INFO_STREAM("onInit(): " << this->getName());
 
@@ -78,7 +196,7 @@ void argus_ros::CameraNodelet::onInit() {
   this->instantiated_publishers_ = false;
 
   // used for detecting a disconnected camera
-  this->last_frame_ = ros::Time::now();
+  this->last_frame_ns_ = ros::Time::now().toNSec();
 
   this->np_ = getMTPrivateNodeHandle();
   this->it_.reset(new image_transport::ImageTransport(this->np_));
@@ -94,6 +212,154 @@ void argus_ros::CameraNodelet::onInit() {
   this->np_.param<std::string>("initial_use_case", this->initial_use_case_,
                                "-");
 
+  bool use_simd;
+  this->np_.param<bool>("use_simd", use_simd, true);
+  NODELET_INFO_STREAM("Pixel conversion kernel: "
+                      << argus_ros::SelectConversionKernel(use_simd));
+
+  std::shared_ptr<FrameConfig> cfg = std::make_shared<FrameConfig>();
+  cfg->optical_frame = this->optical_frame_;
+  cfg->sensor_frame = this->sensor_frame_;
+
+  std::string cloud_fields;
+  this->np_.param<std::string>("cloud_fields", cloud_fields, "xyzi");
+  if (cloud_fields == "xyz") {
+    cfg->cloud_layout = argus_ros::CloudLayout::XYZ;
+  } else if (cloud_fields == "xyzinc") {
+    cfg->cloud_layout = argus_ros::CloudLayout::XYZINC;
+  } else {
+    if (cloud_fields != "xyzi") {
+      NODELET_WARN_STREAM("Unknown cloud_fields: " << cloud_fields
+                          << ", using xyzi");
+    }
+    cfg->cloud_layout = argus_ros::CloudLayout::XYZI;
+  }
+
+  // range of the 16-bit millimeter depth image, anything outside is 0
+  double depth_mm_min, depth_mm_max;
+  this->np_.param<double>("depth_mm_min_range", depth_mm_min, 0.);
+  this->np_.param<double>("depth_mm_max_range", depth_mm_max, 65.535);
+  depth_mm_min = std::max(depth_mm_min, 0.);
+  depth_mm_max = std::min(depth_mm_max, 65.535);
+  if (!(depth_mm_max >= depth_mm_min)) {
+    NODELET_WARN_STREAM("depth_mm_min_range (" << depth_mm_min
+                        << ") must not exceed depth_mm_max_range ("
+                        << depth_mm_max << ") within [0, 65.535], "
+                        << "using the full range");
+    depth_mm_min = 0.;
+    depth_mm_max = 65.535;
+  }
+  cfg->depth_mm_min = depth_mm_min;
+  cfg->depth_mm_max = depth_mm_max;
+
+  int normal_window;
+  this->np_.param<int>("normal_window", normal_window, 7);
+  if ((normal_window < 3) || !(normal_window & 1)) {
+    NODELET_WARN_STREAM("normal_window must be odd and at least 3, got "
+                        << normal_window);
+    normal_window = std::max(normal_window | 1, 3);
+  }
+  cfg->normal_window = normal_window;
+
+  // virtual laser scan
+  double scan_min_height, scan_max_height, scan_angle_increment,
+      scan_range_min, scan_range_max;
+  this->np_.param<double>("scan_min_height", scan_min_height, -0.05);
+  this->np_.param<double>("scan_max_height", scan_max_height, 0.05);
+  this->np_.param<double>("scan_angle_increment", scan_angle_increment,
+                          0.005);
+  this->np_.param<double>("scan_range_min", scan_range_min, 0.1);
+  this->np_.param<double>("scan_range_max", scan_range_max, 10.);
+  if (!(scan_angle_increment > 0.)) {
+    NODELET_WARN_STREAM("scan_angle_increment must be positive, using 0.005");
+    scan_angle_increment = 0.005;
+  }
+  if (!(scan_max_height >= scan_min_height)) {
+    NODELET_WARN_STREAM("scan_min_height (" << scan_min_height
+                        << ") must not exceed scan_max_height ("
+                        << scan_max_height << "), using [-0.05, 0.05]");
+    scan_min_height = -0.05;
+    scan_max_height = 0.05;
+  }
+  if (!(scan_range_min >= 0.) || !(scan_range_max > scan_range_min)) {
+    NODELET_WARN_STREAM("scan_range_min (" << scan_range_min
+                        << ") must be non-negative and below scan_range_max ("
+                        << scan_range_max << "), using [0.1, 10]");
+    scan_range_min = 0.1;
+    scan_range_max = 10.;
+  }
+  cfg->scan.min_height = scan_min_height;
+  cfg->scan.max_height = scan_max_height;
+  cfg->scan.angle_increment = scan_angle_increment;
+  cfg->scan.range_min = scan_range_min;
+  cfg->scan.range_max = scan_range_max;
+
+  // optional binned (downsampled) products, computed in the same pass
+  int binning;
+  std::string binning_method;
+  this->np_.param<int>("binning", binning, 0);
+  this->np_.param<std::string>("binning_method", binning_method, "mean");
+  if (binning > argus_ros::MAX_BIN) {
+    NODELET_WARN_STREAM("binning " << binning << " is too large, using "
+                        << argus_ros::MAX_BIN);
+    binning = argus_ros::MAX_BIN;
+  }
+  cfg->bin = (binning > 1) ? binning : 0;
+  if (binning_method == "min") {
+    cfg->bin_method = argus_ros::BinMethod::MIN;
+  } else if (binning_method == "median") {
+    cfg->bin_method = argus_ros::BinMethod::MEDIAN;
+  } else {
+    if (binning_method != "mean") {
+      NODELET_WARN_STREAM("Unknown binning_method: " << binning_method
+                          << ", using mean");
+    }
+    cfg->bin_method = argus_ros::BinMethod::MEAN;
+  }
+  std::atomic_store(&this->frame_config_,
+                    std::shared_ptr<const FrameConfig>(std::move(cfg)));
+
+  // Row-band parallelism for the pixel conversion. The stream's convert
+  // thread always takes one band, so 0 extra threads means fully serial.
+  int conversion_threads;
+  std::vector<int> conversion_cpus;
+  this->np_.param<int>("conversion_threads", conversion_threads, 0);
+  this->np_.param<std::vector<int> >("conversion_cpus", conversion_cpus,
+                                     std::vector<int>());
+  this->pool_.reset(new argus_ros::WorkerPool(
+      static_cast<std::size_t>(std::max(conversion_threads, 0)),
+      conversion_cpus));
+
+  // Frames are handed from the SDK callback to each stream's convert thread
+  // through a bounded queue (one per stream, see StreamWorker)
+  int queue_depth;
+  std::string queue_policy;
+  this->np_.param<int>("queue_depth", queue_depth, 2);
+  this->np_.param<std::string>("queue_policy", queue_policy, "drop_oldest");
+  this->queue_depth_ = static_cast<std::size_t>(std::max(queue_depth, 1));
+  this->queue_policy_ = argus_ros::DropPolicy::OLDEST;
+  if (!argus_ros::ParseDropPolicy(queue_policy, this->queue_policy_)) {
+    NODELET_WARN_STREAM("Unknown queue_policy: " << queue_policy
+                        << ", using drop_oldest");
+  }
+
+  // A message may be in flight for each queued frame, the frame being
+  // converted, the products waiting for and being published, and in the
+  // publisher queue. Slow intra-process subscribers hold on to more.
+  int min_pool_size =
+      static_cast<int>(this->queue_depth_ + 3 + PUBLISHER_QUEUE_SIZE);
+  int message_pool_size;
+  this->np_.param<int>("message_pool_size", message_pool_size,
+                       min_pool_size);
+  if (message_pool_size < min_pool_size) {
+    NODELET_WARN_STREAM("message_pool_size of " << message_pool_size
+                        << " is below the " << min_pool_size
+                        << " messages that may be in flight, using "
+                        << min_pool_size);
+    message_pool_size = min_pool_size;
+  }
+  this->message_pool_size_ = static_cast<std::size_t>(message_pool_size);
+
   //-------------- BNR -----------/
   this->np_.param<float>("status_secs", stat_secs_, 5.0);
   this->np_.param<std::string>("initial_configuration", this->config_file_, "-");
@@ -196,12 +462,86 @@ bool argus_ros::CameraNodelet::ParseMaskFile() {
     for (int j = 0; j < cols; j++)
       maskfile >> image_mask_.at<float>(i, j);
   NODELET_INFO_STREAM("CameraNodelet::ParseMaskFile: Populated the file");
+
+  std::shared_ptr<const argus_ros::PixelMask> mask =
+      this->CompileImageMask(this->GetFrameConfig()->roi);
+  this->UpdateFrameConfig([&mask, rows, cols](FrameConfig& cfg) {
+    cfg.mask = mask;
+    cfg.mask_width = rows;
+    cfg.mask_height = cols;
+  });
   return true;
 }
 
+std::shared_ptr<const argus_ros::PixelMask>
+argus_ros::CameraNodelet::CompileImageMask(
+    const sensor_msgs::RegionOfInterest& roi) {
+  // the mask is stored transposed: one row per image column
+  sensor_msgs::RegionOfInterest r =
+      ClipRoi(roi, this->image_mask_.rows, this->image_mask_.cols);
+  std::shared_ptr<const argus_ros::PixelMask> mask =
+      std::make_shared<argus_ros::PixelMask>(argus_ros::CompilePixelMask(
+          this->image_mask_.ptr<float>(r.x_offset) + r.y_offset, r.width,
+          r.height, this->image_mask_.step1(), DEPTH_THRESH));
+  NODELET_INFO_STREAM("Image mask: " << mask->indices.size()
+                      << " masked pixels in the " << r.width << "x"
+                      << r.height << " region of interest, using "
+                      << (mask->sparse ? "index list" : "bitset"));
+  return mask;
+}
+
+void argus_ros::CameraNodelet::SetRoi(
+    const sensor_msgs::RegionOfInterest& roi, FrameConfig& cfg) {
+  if ((roi.x_offset >= cfg.uvec_width) ||
+      (roi.y_offset >= cfg.uvec_height)) {
+    NODELET_WARN_STREAM("ROI offset (" << roi.x_offset << ", "
+                        << roi.y_offset << ") is outside of the "
+                        << cfg.uvec_width << "x" << cfg.uvec_height
+                        << " frame, publishing the whole frame");
+  }
+
+  cfg.roi = roi;
+  cfg.mask.reset();
+  if (this->image_mask_loaded_) {
+    cfg.mask = this->CompileImageMask(roi);
+  }
+}
+
+std::shared_ptr<const argus_ros::CameraNodelet::FrameConfig>
+argus_ros::CameraNodelet::GetFrameConfig() const {
+  return std::atomic_load(&this->frame_config_);
+}
+
+void argus_ros::CameraNodelet::UpdateFrameConfig(
+    const std::function<void(FrameConfig&)>& fn) {
+  std::lock_guard<std::mutex> lock(this->frame_config_mutex_);
+  std::shared_ptr<FrameConfig> cfg =
+      std::make_shared<FrameConfig>(*std::atomic_load(&this->frame_config_));
+  fn(*cfg);
+  std::atomic_store(&this->frame_config_,
+                    std::shared_ptr<const FrameConfig>(std::move(cfg)));
+}
+
+void argus_ros::CameraNodelet::PublishImageMask() {
+  if (!image_mask_loaded_) {
+    return;
+  }
+
+  // the mask is static, the latched topic hands it to late subscribers
+  std_msgs::Header head = std_msgs::Header();
+  head.stamp = ros::Time::now();
+  head.frame_id = this->sensor_frame_;
+  image_mask_pub_.publish(
+      cv_bridge::CvImage(head, enc::TYPE_32FC1, image_mask_).toImageMsg());
+}
+
 void argus_ros::CameraNodelet::PublishCameraStatus() {
   argus_ros::CameraOpStatus msg;
   msg.temperature = cur_temp_;
+  msg.frames_dropped = 0;
+  for (auto& worker : this->workers_) {
+    msg.frames_dropped += worker->frames->Dropped();
+  }
   for (auto& freq : cur_mod_freq_)
     msg.frequencies.push_back(freq);
   for (auto& ill : cur_illumin_)
@@ -226,9 +566,9 @@ void argus_ros::CameraNodelet::InitCamera() {
   if (this->cam_ != nullptr) {
     {
       // New scope to check to see if the camera has timedout
-      std::lock_guard<std::mutex> lock(this->last_frame_mutex_);
-      if ((ros::Time::now() - this->last_frame_).toSec() >
-          this->timeout_secs_) {
+      ros::Time last_frame;
+      last_frame.fromNSec(this->last_frame_ns_.load());
+      if ((ros::Time::now() - last_frame).toSec() > this->timeout_secs_) {
         NODELET_WARN_STREAM("Camera timeout!");
         this->cam_.reset();
       }
@@ -312,11 +652,6 @@ void argus_ros::CameraNodelet::InitCamera() {
                 max_num_streams = nstreams;
               }
             }
-
-            // add the use-case to our stream id LUT
-            this->stream_id_lut_.emplace(
-                std::make_pair(std::string(uc.c_str()),
-                               std::vector<std::uint16_t>()));
           }  // end: for(auto& uc : use_cases)
 
           NODELET_INFO_STREAM("Max number of streams: "
@@ -324,47 +659,124 @@ void argus_ros::CameraNodelet::InitCamera() {
           for (std::uint32_t i = 0; i < max_num_streams; ++i) {
             this->intrinsic_pubs_.push_back(
                 this->np_.advertise<sensor_msgs::CameraInfo>(
-                    "stream/" + std::to_string(i + 1) + "/camera_info", 1));
+                    "stream/" + std::to_string(i + 1) + "/camera_info",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->exposure_pubs_.push_back(
                 this->np_.advertise<argus_ros::ExposureTimes>(
                     "stream/" + std::to_string(i + 1) +
                         "/exposure_times",
-                    1));
+                    PUBLISHER_QUEUE_SIZE));
 
             this->cloud_pubs_.push_back(
-                this->np_.advertise<pcl::PointCloud<pcl::PointXYZI> >(
-                    "stream/" + std::to_string(i + 1) + "/cloud", 1));
+                this->np_.advertise<sensor_msgs::PointCloud2>(
+                    "stream/" + std::to_string(i + 1) + "/cloud",
+                    PUBLISHER_QUEUE_SIZE));
+
+            this->compact_cloud_pubs_.push_back(
+                this->np_.advertise<sensor_msgs::PointCloud2>(
+                    "stream/" + std::to_string(i + 1) + "/cloud_compact",
+                    PUBLISHER_QUEUE_SIZE));
+
+            this->voxel_cloud_pubs_.push_back(
+                this->np_.advertise<sensor_msgs::PointCloud2>(
+                    "stream/" + std::to_string(i + 1) + "/cloud_voxel",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->xyz_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/xyz", 1));
+                    "stream/" + std::to_string(i + 1) + "/xyz",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->noise_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/noise", 1));
+                    "stream/" + std::to_string(i + 1) + "/noise",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->gray_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/gray", 1));
+                    "stream/" + std::to_string(i + 1) + "/gray",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->conf_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/conf", 1));
+                    "stream/" + std::to_string(i + 1) + "/conf",
+                    PUBLISHER_QUEUE_SIZE));
 
             //-------------- BNR -----------/
             this->depth_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/depth_image", 1));
+                    "stream/" + std::to_string(i + 1) + "/depth_image",
+                    PUBLISHER_QUEUE_SIZE));
+
+            this->depth_mm_pubs_.push_back(
+                this->it_->advertise(
+                    "stream/" + std::to_string(i + 1) + "/depth_image_mm",
+                    PUBLISHER_QUEUE_SIZE));
+
+            this->normals_pubs_.push_back(
+                this->it_->advertise(
+                    "stream/" + std::to_string(i + 1) + "/normals",
+                    PUBLISHER_QUEUE_SIZE));
+
+            this->scan_pubs_.push_back(
+                this->np_.advertise<sensor_msgs::LaserScan>(
+                    "stream/" + std::to_string(i + 1) + "/scan",
+                    PUBLISHER_QUEUE_SIZE));
 
             this->unit_vec_pubs_.push_back(
                 this->it_->advertise(
-                    "stream/" + std::to_string(i + 1) + "/unit_vectors", 1));
+                    "stream/" + std::to_string(i + 1) + "/unit_vectors", 1,
+                    true));
             //------------------------------/
+
+            if (this->GetFrameConfig()->bin > 0) {
+              this->binned_info_pubs_.push_back(
+                  this->np_.advertise<sensor_msgs::CameraInfo>(
+                      "stream/" + std::to_string(i + 1) +
+                          "/binned/camera_info",
+                      PUBLISHER_QUEUE_SIZE));
+
+              this->binned_depth_pubs_.push_back(
+                  this->it_->advertise(
+                      "stream/" + std::to_string(i + 1) +
+                          "/binned/depth_image",
+                      PUBLISHER_QUEUE_SIZE));
+
+              this->binned_cloud_pubs_.push_back(
+                  this->np_.advertise<sensor_msgs::PointCloud2>(
+                      "stream/" + std::to_string(i + 1) + "/binned/cloud",
+                      PUBLISHER_QUEUE_SIZE));
+            }
+
+            this->stream_buffers_.emplace_back(
+                new argus_ros::CameraNodelet::StreamBuffers(
+                    this->message_pool_size_));
+          }
+
+          //
+          // Each stream gets its own queue and threads so that, e.g., the
+          // slow stream of a mixed-mode use case never holds up the fast one.
+          // These start only once all of the per-stream publishers exist.
+          //
+          for (std::uint32_t i = 0; i < max_num_streams; ++i) {
+            this->workers_.emplace_back(
+                new argus_ros::CameraNodelet::StreamWorker());
+            argus_ros::CameraNodelet::StreamWorker* worker =
+                this->workers_.back().get();
+            worker->frames.reset(new argus_ros::FrameQueue<Frame>(
+                this->queue_depth_, this->queue_policy_));
+            worker->products.reset(new argus_ros::FrameQueue<Products>(
+                1, argus_ros::DropPolicy::BLOCK));
+            worker->convert_thread = std::thread(&CameraNodelet::ConvertLoop,
+                                                 this, i, worker);
+            worker->publish_thread = std::thread(&CameraNodelet::PublishLoop,
+                                                 this, i, worker);
           }
           //-------------- BNR -----------/
           this->image_mask_pub_ = this->np_.advertise<sensor_msgs::Image>(
-              "stream/image_mask", 1);
+              "stream/image_mask", 1, true);
+          this->PublishImageMask();
           this->cam_hw_info_pub_ = this->np_.advertise<argus_ros::CameraOpStatus>(
               "stream/camera_op_status", 1);
           //------------------------------/
@@ -381,10 +793,9 @@ void argus_ros::CameraNodelet::InitCamera() {
 }
 
 void argus_ros::CameraNodelet::CacheIntrinsics() {
-  std::lock_guard<std::mutex> lock(this->intrinsic_mutex_);
   NODELET_INFO_STREAM("Caching intrinsic calibration...");
 
-  this->intrinsic_msg_ = sensor_msgs::CameraInfo();
+  sensor_msgs::CameraInfo info;
 
   argus::LensParameters intrinsics;
   argus::CameraStatus status = this->cam_->getLensParameters(intrinsics);
@@ -409,53 +820,56 @@ void argus_ros::CameraNodelet::CacheIntrinsics() {
   }
 
   // image dimensions
-  this->intrinsic_msg_.height = max_height;
-  this->intrinsic_msg_.width = max_width;
+  info.height = max_height;
+  info.width = max_width;
 
   // radial and tangential distortion
-  this->intrinsic_msg_.distortion_model = "plumb_bob";
-  this->intrinsic_msg_.D.resize(5);
-  this->intrinsic_msg_.D[0] = intrinsics.distortionRadial[0];
-  this->intrinsic_msg_.D[1] = intrinsics.distortionRadial[1];
-  this->intrinsic_msg_.D[2] = intrinsics.distortionTangential.first;
-  this->intrinsic_msg_.D[3] = intrinsics.distortionTangential.second;
-  this->intrinsic_msg_.D[4] = intrinsics.distortionRadial[2];
+  info.distortion_model = "plumb_bob";
+  info.D.resize(5);
+  info.D[0] = intrinsics.distortionRadial[0];
+  info.D[1] = intrinsics.distortionRadial[1];
+  info.D[2] = intrinsics.distortionTangential.first;
+  info.D[3] = intrinsics.distortionTangential.second;
+  info.D[4] = intrinsics.distortionRadial[2];
 
   // camera matrix
-  this->intrinsic_msg_.K[0] = intrinsics.focalLength.first;
-  this->intrinsic_msg_.K[1] = 0;
-  this->intrinsic_msg_.K[2] = intrinsics.principalPoint.first;
-  this->intrinsic_msg_.K[3] = 0;
-  this->intrinsic_msg_.K[4] = intrinsics.focalLength.second;
-  this->intrinsic_msg_.K[5] = intrinsics.principalPoint.second;
-  this->intrinsic_msg_.K[6] = 0;
-  this->intrinsic_msg_.K[7] = 0;
-  this->intrinsic_msg_.K[8] = 1;
+  info.K[0] = intrinsics.focalLength.first;
+  info.K[1] = 0;
+  info.K[2] = intrinsics.principalPoint.first;
+  info.K[3] = 0;
+  info.K[4] = intrinsics.focalLength.second;
+  info.K[5] = intrinsics.principalPoint.second;
+  info.K[6] = 0;
+  info.K[7] = 0;
+  info.K[8] = 1;
 
   // rectification matrix
-  this->intrinsic_msg_.R[0] = 1;
-  this->intrinsic_msg_.R[1] = 0;
-  this->intrinsic_msg_.R[2] = 0;
-  this->intrinsic_msg_.R[3] = 0;
-  this->intrinsic_msg_.R[4] = 1;
-  this->intrinsic_msg_.R[5] = 0;
-  this->intrinsic_msg_.R[6] = 0;
-  this->intrinsic_msg_.R[7] = 0;
-  this->intrinsic_msg_.R[8] = 1;
+  info.R[0] = 1;
+  info.R[1] = 0;
+  info.R[2] = 0;
+  info.R[3] = 0;
+  info.R[4] = 1;
+  info.R[5] = 0;
+  info.R[6] = 0;
+  info.R[7] = 0;
+  info.R[8] = 1;
 
   // projection matrix
-  this->intrinsic_msg_.P[0] = intrinsics.focalLength.first;
-  this->intrinsic_msg_.P[1] = 0;
-  this->intrinsic_msg_.P[2] = intrinsics.principalPoint.first;
-  this->intrinsic_msg_.P[3] = 0;
-  this->intrinsic_msg_.P[4] = 0;
-  this->intrinsic_msg_.P[5] = intrinsics.focalLength.second;
-  this->intrinsic_msg_.P[6] = intrinsics.principalPoint.second;
-  this->intrinsic_msg_.P[7] = 0;
-  this->intrinsic_msg_.P[8] = 0;
-  this->intrinsic_msg_.P[9] = 0;
-  this->intrinsic_msg_.P[10] = 1;
-  this->intrinsic_msg_.P[11] = 0;
+  info.P[0] = intrinsics.focalLength.first;
+  info.P[1] = 0;
+  info.P[2] = intrinsics.principalPoint.first;
+  info.P[3] = 0;
+  info.P[4] = 0;
+  info.P[5] = intrinsics.focalLength.second;
+  info.P[6] = intrinsics.principalPoint.second;
+  info.P[7] = 0;
+  info.P[8] = 0;
+  info.P[9] = 0;
+  info.P[10] = 1;
+  info.P[11] = 0;
+
+  this->UpdateFrameConfig(
+      [&info](FrameConfig& cfg) { cfg.intrinsics = std::move(info); });
 }
 
 void argus_ros::CameraNodelet::StartCameraStream() {
@@ -472,14 +886,15 @@ void argus_ros::CameraNodelet::StartCameraStream() {
   }
 
   {
-    std::lock_guard<std::mutex> lock(this->current_use_case_mutex_);
     std::string current_use_case;
     if (this->cam_->getCurrentUseCase(current_use_case) == OK_) {
-      this->current_use_case_ = std::string(current_use_case.c_str());
+      current_use_case = std::string(current_use_case.c_str());
     } else {
       NODELET_WARN_STREAM("Could not discover current use case!");
-      this->current_use_case_ = "UNKNOWN";
+      current_use_case = "UNKNOWN";
     }
+
+    this->SetCurrentUseCase(current_use_case);
   }
 
   if (this->cam_->registerDataListenerExtended(this) != OK_) {
@@ -511,26 +926,110 @@ void argus_ros::CameraNodelet::StartCameraStream() {
 
   this->cam_->startCapture();
 
-  {
-    std::lock_guard<std::mutex> lock(this->last_frame_mutex_);
-    this->last_frame_ = ros::Time::now();
-  }
+  this->last_frame_ns_ = ros::Time::now().toNSec();
 
   {
     std::lock_guard<std::mutex> chlock(this->hw_mutex_);
     this->last_stat_frame_ = ros::Time::now();
   }
 
-  // Populate unit vecetors
-  uvec_data_.reset(new argus::DepthData);
-  if (this->cam_->getLensDirections(*uvec_data_) != OK_) {
-    NODELET_WARN_STREAM("Unable to access unit vectors!");
+  if (!this->PublishUnitVectors()) {
     return;
   }
 
   NODELET_INFO_STREAM("Camera started!");
 }
 
+bool argus_ros::CameraNodelet::PublishUnitVectors() {
+  std::unique_ptr<argus::DepthData> uvec(new argus::DepthData);
+  if (this->cam_->getLensDirections(*uvec) != OK_) {
+    NODELET_WARN_STREAM("Unable to access unit vectors!");
+    return false;
+  }
+
+  //
+  // The unit vectors only depend on the camera and its use case, so we build
+  // the image once here and let the latched publishers hand it to late
+  // subscribers instead of republishing it with every frame
+  //
+  sensor_msgs::RegionOfInterest roi =
+      ClipRoi(this->GetFrameConfig()->roi, uvec->width, uvec->height);
+
+  sensor_msgs::ImagePtr msg(new sensor_msgs::Image());
+  msg->header.stamp = ros::Time::now();
+  msg->header.frame_id = this->optical_frame_;
+  msg->height = roi.height;
+  msg->width = roi.width;
+  msg->encoding = enc::TYPE_32FC3;
+  msg->is_bigendian = false;
+  msg->step = roi.width * 3 * sizeof(float);
+  msg->data.resize(msg->step * roi.height);
+
+  float* u = reinterpret_cast<float*>(msg->data.data());
+  for (std::uint32_t row = roi.y_offset; row < roi.y_offset + roi.height;
+       ++row) {
+    const argus::DepthPoint* pt =
+        uvec->points.data() + row * uvec->width + roi.x_offset;
+    for (std::uint32_t col = 0; col < roi.width; ++col, ++pt) {
+      *u++ = pt->x;
+      *u++ = pt->y;
+      *u++ = pt->z;
+    }
+  }
+
+  // the angle bins of the virtual scan come from the same lens directions
+  std::shared_ptr<const argus_ros::ScanTable> scan_table =
+      std::make_shared<argus_ros::ScanTable>(argus_ros::BuildScanTable(
+          uvec->points.data(), uvec->width, roi.x_offset, roi.y_offset,
+          roi.width, roi.height, this->GetFrameConfig()->scan));
+
+  this->UpdateFrameConfig([&uvec, &scan_table](FrameConfig& cfg) {
+    cfg.uvec_width = uvec->width;
+    cfg.uvec_height = uvec->height;
+    cfg.scan_table = scan_table;
+  });
+
+  for (auto& pub : this->unit_vec_pubs_) {
+    pub.publish(msg);
+  }
+
+  return true;
+}
+
+void argus_ros::CameraNodelet::SetCurrentUseCase(
+    const std::string& use_case) {
+  //
+  // Map the stream ids of the use case onto our publishers, in the order the
+  // camera reports them, so that the frame callback can find its publisher
+  // with a single array lookup
+  //
+  std::vector<std::int8_t> stream_index;
+  std::vector<argus::StreamId> streamids;
+  if (this->cam_->getStreams(streamids) != OK_) {
+    NODELET_WARN_STREAM("Could not get the streams of use case: "
+                        << use_case);
+  }
+
+  for (std::size_t i = 0; i < streamids.size(); ++i) {
+    std::uint16_t sid = static_cast<std::uint16_t>(streamids[i]);
+    if (i >= this->intrinsic_pubs_.size()) {
+      NODELET_WARN_STREAM("No publisher for stream " << sid << " of use case "
+                          << use_case);
+      continue;
+    }
+
+    if (sid >= stream_index.size()) {
+      stream_index.resize(sid + 1, -1);
+    }
+    stream_index[sid] = static_cast<std::int8_t>(i);
+  }
+
+  this->UpdateFrameConfig([&use_case, &stream_index](FrameConfig& cfg) {
+    cfg.use_case = use_case;
+    cfg.stream_index = std::move(stream_index);
+  });
+}
+
 void argus_ros::CameraNodelet::RescheduleTimer() {
   this->timer_.stop();
   this->timer_.setPeriod(ros::Duration(this->poll_bus_secs_));
@@ -563,17 +1062,18 @@ int argus_ros::CameraNodelet::SetConfigurationParams(json& j,
 
           if (status == OK_) {
             {
-              std::lock_guard<std::mutex>
-                  lock(this->current_use_case_mutex_);
               std::string current_use_case;
               if (this->cam_->getCurrentUseCase(
                       current_use_case) == OK_) {
-                this->current_use_case_ =
-                    std::string(current_use_case.c_str());
+                this->SetCurrentUseCase(
+                    std::string(current_use_case.c_str()));
               } else {
                 NODELET_WARN_STREAM("current_use_case is stale!");
               }
             }
+
+            // the lens directions follow the resolution of the use case
+            this->PublishUnitVectors();
           }
         } else if (key == "ExposureMode") {
           json emode_dict = uc_root[key];
@@ -705,6 +1205,192 @@ int argus_ros::CameraNodelet::SetConfigurationParams(json& j,
       }
     }
   }
+
+  //
+  // Driver (i.e., argus-ros side) parameters
+  //
+  json j_drv = j["Driver"];
+  if (!j_drv.is_null()) {
+    //
+    // All sections are applied to one copy of the configuration, which is
+    // swapped in once all of them are valid: frames never see half of a
+    // request, and a rejected request changes nothing
+    //
+    FrameConfig next(*this->GetFrameConfig());
+    bool roi_changed = false;
+    try {
+      if (j_drv.count("ROI") == 1) {
+        json j_roi = j_drv["ROI"];
+        auto field = [&j_roi](const std::string& key) -> std::uint32_t {
+          int val = j_roi.count(key) ? JsonToInt(j_roi[key]) : 0;
+          if (val < 0) {
+            throw std::out_of_range("ROI " + key + " must not be negative");
+          }
+          return val;
+        };
+
+        sensor_msgs::RegionOfInterest roi;
+        roi.x_offset = field("XOffset");
+        roi.y_offset = field("YOffset");
+        roi.width = field("Width");
+        roi.height = field("Height");
+        this->SetRoi(roi, next);
+        roi_changed = true;
+      }
+
+      if (j_drv.count("Gating") == 1) {
+        json j_gate = j_drv["Gating"];
+        int min_conf = j_gate.count("MinConfidence") ?
+            JsonToInt(j_gate["MinConfidence"]) : next.min_confidence;
+        float min_range = j_gate.count("MinRange") ?
+            JsonToFloat(j_gate["MinRange"]) : next.min_range;
+        float max_range = j_gate.count("MaxRange") ?
+            JsonToFloat(j_gate["MaxRange"]) : next.max_range;
+        float max_noise = j_gate.count("MaxNoise") ?
+            JsonToFloat(j_gate["MaxNoise"]) : next.max_noise;
+
+        if ((min_conf < 1) || (min_conf > 255)) {
+          throw std::out_of_range("Gating MinConfidence must be in [1, 255]");
+        }
+        if (!(min_range >= 0.f) || !(max_range >= min_range)) {
+          throw std::out_of_range("Gating needs 0 <= MinRange <= MaxRange");
+        }
+        if (!(max_noise >= 0.f)) {
+          throw std::out_of_range("Gating MaxNoise must not be negative");
+        }
+
+        next.min_confidence = static_cast<std::uint8_t>(min_conf);
+        next.min_range = min_range;
+        next.max_range = max_range;
+        next.max_noise = max_noise;
+      }
+
+      if (j_drv.count("SpatialFilter") == 1) {
+        json j_sf = j_drv["SpatialFilter"];
+        argus_ros::SpatialParams& sf = next.spatial;
+        if (j_sf.count("Iterations") == 1) {
+          sf.iterations = JsonToInt(j_sf["Iterations"]);
+        }
+        if (j_sf.count("SigmaS") == 1) {
+          sf.sigma_s = JsonToFloat(j_sf["SigmaS"]);
+        }
+        if (j_sf.count("SigmaR") == 1) {
+          sf.sigma_r = JsonToFloat(j_sf["SigmaR"]);
+        }
+
+        if ((sf.iterations < 0) ||
+            (sf.iterations > argus_ros::MAX_SPATIAL_ITERATIONS)) {
+          throw std::out_of_range(
+              "SpatialFilter Iterations must be in [0, " +
+              std::to_string(argus_ros::MAX_SPATIAL_ITERATIONS) + "]");
+        }
+        if (!(sf.sigma_s > 0.f) || !(sf.sigma_r > 0.f)) {
+          throw std::out_of_range(
+              "SpatialFilter SigmaS and SigmaR must be positive");
+        }
+      }
+
+      if (j_drv.count("TemporalFilter") == 1) {
+        json j_tf = j_drv["TemporalFilter"];
+        argus_ros::TemporalParams& tf = next.temporal;
+        if (j_tf.count("Mode") == 1) {
+          std::string mode = j_tf["Mode"];
+          boost::algorithm::to_lower(mode);
+          if (mode == "none") {
+            tf.mode = argus_ros::TemporalMode::NONE;
+          } else if (mode == "ema") {
+            tf.mode = argus_ros::TemporalMode::EMA;
+          } else if (mode == "median") {
+            tf.mode = argus_ros::TemporalMode::MEDIAN;
+          } else if (mode == "weighted") {
+            tf.mode = argus_ros::TemporalMode::WEIGHTED;
+          } else {
+            throw std::invalid_argument("Unknown TemporalFilter Mode: " +
+                                        mode);
+          }
+        }
+        if (j_tf.count("History") == 1) {
+          tf.history = JsonToInt(j_tf["History"]);
+        }
+        if (j_tf.count("Alpha") == 1) {
+          tf.alpha = JsonToFloat(j_tf["Alpha"]);
+        }
+        if (j_tf.count("MaxJump") == 1) {
+          tf.max_jump = JsonToFloat(j_tf["MaxJump"]);
+        }
+        if (j_tf.count("MotionFraction") == 1) {
+          tf.motion_fraction = JsonToFloat(j_tf["MotionFraction"]);
+        }
+
+        if ((tf.history < 1) || (tf.history > argus_ros::MAX_HISTORY)) {
+          throw std::out_of_range("TemporalFilter History must be in [1, " +
+                                  std::to_string(argus_ros::MAX_HISTORY) +
+                                  "]");
+        }
+        if (!(tf.alpha > 0.f) || !(tf.alpha <= 1.f)) {
+          throw std::out_of_range("TemporalFilter Alpha must be in (0, 1]");
+        }
+        if (!(tf.max_jump > 0.f) || !(tf.motion_fraction >= 0.f)) {
+          throw std::out_of_range(
+              "TemporalFilter MaxJump and MotionFraction must be positive");
+        }
+      }
+
+      if (j_drv.count("Voxel") == 1) {
+        json j_vox = j_drv["Voxel"];
+        argus_ros::VoxelParams& vox = next.voxel;
+        if (j_vox.count("LeafSize") == 1) {
+          vox.leaf_size = JsonToFloat(j_vox["LeafSize"]);
+        }
+        if (j_vox.count("Reduction") == 1) {
+          std::string reduction = j_vox["Reduction"];
+          boost::algorithm::to_lower(reduction);
+          if (reduction == "centroid") {
+            vox.reduction = argus_ros::VoxelReduction::CENTROID;
+          } else if (reduction == "nearest") {
+            vox.reduction = argus_ros::VoxelReduction::NEAREST;
+          } else if (reduction == "maxintensity") {
+            vox.reduction = argus_ros::VoxelReduction::MAX_INTENSITY;
+          } else {
+            throw std::invalid_argument("Unknown Voxel Reduction: " +
+                                        reduction);
+          }
+        }
+
+        if (!(vox.leaf_size >= 0.001f)) {
+          throw std::out_of_range("Voxel LeafSize must be at least 0.001");
+        }
+      }
+    } catch (const std::exception& ex) {
+      status_ret = -1;
+      status_msg = ex.what();
+      NODELET_WARN_STREAM("While processing Driver settings: " << ex.what());
+      NODELET_INFO_STREAM("json was:\n" << j);
+      return status_ret;
+    }
+
+    // only the fields set here are taken over, the rest (use case, unit
+    // vectors) may have changed in the meantime
+    this->UpdateFrameConfig([&next, roi_changed](FrameConfig& c) {
+      if (roi_changed) {
+        c.roi = next.roi;
+        c.mask = next.mask;
+      }
+      c.min_confidence = next.min_confidence;
+      c.min_range = next.min_range;
+      c.max_range = next.max_range;
+      c.max_noise = next.max_noise;
+      c.spatial = next.spatial;
+      c.temporal = next.temporal;
+      c.voxel = next.voxel;
+    });
+
+    // the unit vectors are cropped as well
+    if (roi_changed) {
+      this->PublishUnitVectors();
+    }
+  }
+
   return status_ret;
 }
 
@@ -798,10 +1484,7 @@ bool argus_ros::CameraNodelet::Config(argus_ros::Config::Request& req,
   resp.msg = ret_msg;
 
   // avoid camera timeouts
-  {
-    std::lock_guard<std::mutex> lock(this->last_frame_mutex_);
-    this->last_frame_ = ros::Time::now();
-  }
+  this->last_frame_ns_ = ros::Time::now().toNSec();
 
   return true;
 }
@@ -843,11 +1526,7 @@ bool argus_ros::CameraNodelet::Dump(argus_ros::Dump::Request& req,
                    [](std::string& s) -> std::string { return std::string(s.c_str()); });
   }
 
-  std::string current_use_case;
-  {
-    std::lock_guard<std::mutex> lock(this->current_use_case_mutex_);
-    current_use_case = this->current_use_case_;
-  }
+  std::string current_use_case = this->GetFrameConfig()->use_case;
 
   std::uint32_t nstreams = 0;
   this->cam_->getNumberOfStreams(std::string(current_use_case.c_str()),
@@ -960,6 +1639,38 @@ bool argus_ros::CameraNodelet::Dump(argus_ros::Dump::Request& req,
           {"FrameRate", std::to_string(fps)},
           {"MaxFrameRate", std::to_string(max_fps)}}}}}};
 
+  static const char* temporal_modes[] = {"None", "EMA", "Median",
+                                         "Weighted"};
+  static const char* voxel_reductions[] = {"Centroid", "Nearest",
+                                           "MaxIntensity"};
+  std::shared_ptr<const FrameConfig> cfg = this->GetFrameConfig();
+  const sensor_msgs::RegionOfInterest& roi = cfg->roi;
+  j["Driver"] = {
+      {"ROI",
+       {{"XOffset", std::to_string(roi.x_offset)},
+        {"YOffset", std::to_string(roi.y_offset)},
+        {"Width", std::to_string(roi.width)},
+        {"Height", std::to_string(roi.height)}}},
+      {"Gating",
+       {{"MinConfidence", std::to_string(cfg->min_confidence)},
+        {"MinRange", std::to_string(cfg->min_range)},
+        {"MaxRange", std::to_string(cfg->max_range)},
+        {"MaxNoise", std::to_string(cfg->max_noise)}}},
+      {"SpatialFilter",
+       {{"Iterations", std::to_string(cfg->spatial.iterations)},
+        {"SigmaS", std::to_string(cfg->spatial.sigma_s)},
+        {"SigmaR", std::to_string(cfg->spatial.sigma_r)}}},
+      {"TemporalFilter",
+       {{"Mode", temporal_modes[static_cast<int>(cfg->temporal.mode)]},
+        {"History", std::to_string(cfg->temporal.history)},
+        {"Alpha", std::to_string(cfg->temporal.alpha)},
+        {"MaxJump", std::to_string(cfg->temporal.max_jump)},
+        {"MotionFraction", std::to_string(cfg->temporal.motion_fraction)}}},
+      {"Voxel",
+       {{"LeafSize", std::to_string(cfg->voxel.leaf_size)},
+        {"Reduction",
+         voxel_reductions[static_cast<int>(cfg->voxel.reduction)]}}}};
+
   resp.config = j.dump(2);
   return true;
 }
@@ -1008,8 +1719,10 @@ void argus_ros::CameraNodelet::onNewData(const argus::IExtendedData* edata) {
   if (edata->hasRawData()) {
     auto raw = edata->getRawData();
 
-    {
-      std::lock_guard<std::mutex> tlock(hw_mutex_);
+    // the status is only sampled every `stat_secs_`, so rather than waiting
+    // on the timer thread we just skip this frame's update while it publishes
+    std::unique_lock<std::mutex> tlock(hw_mutex_, std::try_to_lock);
+    if (tlock.owns_lock()) {
       cur_temp_ = raw->illuminationTemperature;
       cur_mod_freq_.clear();
       for (auto curMod : raw->modulationFrequencies) {
@@ -1022,222 +1735,542 @@ void argus_ros::CameraNodelet::onNewData(const argus::IExtendedData* edata) {
     }
   }
 
-  if (uvec_data_->height != data->height ||
-      uvec_data_->width != data->width) {
-    NODELET_ERROR_STREAM("Unit vector data and depth image are not of the same size!");
-    return;
-  }
-
   auto stamp = ros::Time(static_cast<double>(data->timeStamp.count()) / 1e6);
-  {
-    std::lock_guard<std::mutex> lock(this->last_frame_mutex_);
-    this->last_frame_ = stamp;
-  }
+  this->last_frame_ns_ = stamp.toNSec();
 
   // Determine the index into the publishers vector that we will push this
   // image stream out to -- we do this so the function generalizes to mixed-mode
   // use cases
-  int idx = 0;
-  try {
-    auto& stream_ids = this->stream_id_lut_.at(this->current_use_case_);
-    auto result = std::find(stream_ids.begin(), stream_ids.end(),
-                            (std::uint16_t)data->streamId);
-    if (result != stream_ids.end()) {
-      // NODELET_INFO_STREAM("Cache Hit!");
-      idx = std::distance(stream_ids.begin(), result);
+  std::shared_ptr<const FrameConfig> cfg = this->GetFrameConfig();
+  std::uint16_t sid = static_cast<std::uint16_t>(data->streamId);
+  int idx = (sid < cfg->stream_index.size()) ? cfg->stream_index[sid] : -1;
+  if (idx < 0) {
+    NODELET_WARN_STREAM_THROTTLE(5, "Dropping frame of unknown stream "
+                                 << sid << " (use case: " << cfg->use_case
+                                 << ")");
+    return;
+  }
+
+  //
+  // Everything else happens on the stream's own threads. We only copy the
+  // frame into a recycled queue slot so that slow subscribers or
+  // serialization spikes never hold up the SDK's callback thread.
+  //
+  argus_ros::FrameQueue<Frame>& frames = *this->workers_[idx]->frames;
+  argus_ros::CameraNodelet::Frame* frame = frames.Acquire();
+  if (frame == nullptr) {
+    NODELET_WARN_STREAM_THROTTLE(5, "Frame queue of stream " << idx + 1
+                                 << " full, dropping frame ("
+                                 << frames.Dropped() << " dropped so far)");
+    return;
+  }
+
+  // only the region of interest is copied, and converted from here on
+  sensor_msgs::RegionOfInterest roi =
+      ClipRoi(cfg->roi, data->width, data->height);
+
+  frame->timeStamp = data->timeStamp;
+  frame->streamId = data->streamId;
+  frame->width = roi.width;
+  frame->height = roi.height;
+  frame->full_width = data->width;
+  frame->full_height = data->height;
+  frame->roi = roi;
+  frame->config = cfg;
+  frame->exposureTimes.assign(data->exposureTimes.begin(),
+                              data->exposureTimes.end());
+  frame->points.resize(static_cast<std::size_t>(roi.width) * roi.height);
+  for (std::uint32_t row = 0; row < roi.height; ++row) {
+    auto first = data->points.begin() +
+                 (roi.y_offset + row) * data->width + roi.x_offset;
+    std::copy(first, first + roi.width,
+              frame->points.begin() + row * roi.width);
+  }
+  frames.Push(frame);
+}
+
+//
+// The frames go through two pipelined stages on two threads: while the
+// messages of one frame are being serialized and published, the pixels of
+// the next one are already being converted. The stages are connected by a
+// FIFO, so messages still go out in frame order.
+//
+void argus_ros::CameraNodelet::ConvertLoop(
+    int idx, argus_ros::CameraNodelet::StreamWorker* worker) {
+  for (argus_ros::CameraNodelet::Frame* frame = worker->frames->Pop();
+       frame != nullptr; frame = worker->frames->Pop()) {
+    // waits for the publisher if it has fallen a frame behind
+    argus_ros::CameraNodelet::Products* products = worker->products->Acquire();
+    if (products == nullptr) {
+      worker->frames->Release(frame);
+      break;
+    }
+
+    bool any = this->ConvertFrame(idx, this->WantedProducts(idx), *frame,
+                                  *products);
+    worker->frames->Release(frame);
+
+    if (any) {
+      worker->products->Push(products);
     } else {
-      NODELET_INFO_STREAM("StreamId cache miss: " << (int)data->streamId);
-      stream_ids.push_back(data->streamId);
-      idx = stream_ids.size() - 1;
+      worker->products->Release(products);
+    }
+  }
+}
+
+void argus_ros::CameraNodelet::PublishLoop(
+    int idx, argus_ros::CameraNodelet::StreamWorker* worker) {
+  for (argus_ros::CameraNodelet::Products* products = worker->products->Pop();
+       products != nullptr; products = worker->products->Pop()) {
+    this->PublishProducts(idx, *products);
+    worker->products->Release(products);
+  }
+}
+
+void argus_ros::CameraNodelet::PublishProducts(
+    int idx, argus_ros::CameraNodelet::Products& products) {
+  if (products.info) this->intrinsic_pubs_[idx].publish(products.info);
+  if (products.exposure) this->exposure_pubs_[idx].publish(products.exposure);
+  if (products.gray) this->gray_pubs_[idx].publish(products.gray);
+  if (products.conf) this->conf_pubs_[idx].publish(products.conf);
+  if (products.noise) this->noise_pubs_[idx].publish(products.noise);
+  if (products.cloud) this->cloud_pubs_[idx].publish(products.cloud);
+  if (products.compact_cloud) {
+    this->compact_cloud_pubs_[idx].publish(products.compact_cloud);
+  }
+  if (products.voxel_cloud) {
+    this->voxel_cloud_pubs_[idx].publish(products.voxel_cloud);
+  }
+  if (products.xyz) this->xyz_pubs_[idx].publish(products.xyz);
+
+  //-------------- BNR -----------/
+  if (products.depth) this->depth_pubs_[idx].publish(products.depth);
+  if (products.depth_mm) this->depth_mm_pubs_[idx].publish(products.depth_mm);
+  //------------------------------/
+
+  if (products.normals) this->normals_pubs_[idx].publish(products.normals);
+  if (products.scan) this->scan_pubs_[idx].publish(products.scan);
+
+  if (products.binned_info) {
+    this->binned_info_pubs_[idx].publish(products.binned_info);
+  }
+  if (products.binned_depth) {
+    this->binned_depth_pubs_[idx].publish(products.binned_depth);
+  }
+  if (products.binned_cloud) {
+    this->binned_cloud_pubs_[idx].publish(products.binned_cloud);
+  }
+
+  // let the pools recycle the messages once the transport is done with them
+  products = argus_ros::CameraNodelet::Products();
+}
+
+//
+// Figure out which products anyone is actually listening to. Building and
+// serializing the images and cloud dominates the cost of each frame, so we
+// only fill the channels that have at least one subscriber. The stream index
+// table only maps onto existing publishers, so `idx` is in range. Only this
+// stream's threads ever touch its publishers and buffers.
+//
+argus_ros::CameraNodelet::Wants argus_ros::CameraNodelet::WantedProducts(
+    int idx) const {
+  argus_ros::CameraNodelet::Wants want;
+  want.info = this->intrinsic_pubs_[idx].getNumSubscribers() > 0;
+  want.exposure = this->exposure_pubs_[idx].getNumSubscribers() > 0;
+  want.gray = this->gray_pubs_[idx].getNumSubscribers() > 0;
+  want.conf = this->conf_pubs_[idx].getNumSubscribers() > 0;
+  want.noise = this->noise_pubs_[idx].getNumSubscribers() > 0;
+  want.xyz = this->xyz_pubs_[idx].getNumSubscribers() > 0;
+  want.depth = this->depth_pubs_[idx].getNumSubscribers() > 0;
+  want.depth_mm = this->depth_mm_pubs_[idx].getNumSubscribers() > 0;
+  want.cloud = this->cloud_pubs_[idx].getNumSubscribers() > 0;
+  want.compact = this->compact_cloud_pubs_[idx].getNumSubscribers() > 0;
+  want.voxel = this->voxel_cloud_pubs_[idx].getNumSubscribers() > 0;
+  want.normals = this->normals_pubs_[idx].getNumSubscribers() > 0;
+  want.scan = this->scan_pubs_[idx].getNumSubscribers() > 0;
+  if (!this->binned_info_pubs_.empty()) {
+    want.binned_info = this->binned_info_pubs_[idx].getNumSubscribers() > 0;
+    want.binned_depth =
+        this->binned_depth_pubs_[idx].getNumSubscribers() > 0;
+    want.binned_cloud =
+        this->binned_cloud_pubs_[idx].getNumSubscribers() > 0;
+  }
+  return want;
+}
+
+bool argus_ros::CameraNodelet::ConvertFrame(
+    int idx, const argus_ros::CameraNodelet::Wants& want,
+    argus_ros::CameraNodelet::Frame& frame,
+    argus_ros::CameraNodelet::Products& products) {
+  const argus_ros::CameraNodelet::Frame* data = &frame;
+
+  // the configuration the frame was cropped with, a newer one may not match
+  // its region of interest
+  const std::shared_ptr<const FrameConfig>& cfg = data->config;
+
+  if ((cfg->uvec_height != data->full_height) ||
+      (cfg->uvec_width != data->full_width)) {
+    NODELET_ERROR_STREAM("Unit vector data and depth image are not of the same size!");
+    return false;
+  }
+
+  auto stamp = ros::Time(static_cast<double>(data->timeStamp.count()) / 1e6);
+
+  // the scan needs a table built for this frame's region of interest
+  bool want_scan = want.scan && cfg->scan_table &&
+                   (cfg->scan_table->nbins > 0) &&
+                   (cfg->scan_table->width == data->width) &&
+                   (cfg->scan_table->height == data->height);
+
+  argus_ros::CameraNodelet::StreamBuffers& bufs = *this->stream_buffers_[idx];
+  if ((bufs.width != data->width) || (bufs.height != data->height)) {
+    // new resolution, let go of the buffers sized for the old one
+    bufs = argus_ros::CameraNodelet::StreamBuffers(bufs.pool_size);
+    bufs.width = data->width;
+    bufs.height = data->height;
+
+    if (cfg->mask &&
+        ((cfg->mask_width != data->full_width) ||
+         (cfg->mask_height != data->full_height))) {
+      NODELET_ERROR_STREAM("Image mask is " << cfg->mask_width << "x"
+                           << cfg->mask_height << " but stream "
+                           << idx + 1 << " is " << data->full_width << "x"
+                           << data->full_height << ", not applying it");
     }
-  } catch (const std::out_of_range& ex) {
-    NODELET_ERROR_STREAM(ex.what());
-    NODELET_WARN_STREAM("No publisher for use case: "
-                        << this->current_use_case_);
-    return;
   }
 
   //
   // 2D images are published in optical frame, 3D cloud(s) are published in
-  // sensor frame
+  // sensor frame. The headers live in the stream's buffers so that the frame
+  // ids keep their capacity from frame to frame.
   //
-  std_msgs::Header head = std_msgs::Header();
-  head.stamp = stamp;
-  head.frame_id = this->optical_frame_;
-
-  std_msgs::Header cloud_head = std_msgs::Header();
-  cloud_head.stamp = stamp;
-  cloud_head.frame_id = this->sensor_frame_;
+  bufs.head.stamp = stamp;
+  bufs.head.frame_id = cfg->optical_frame;
+  bufs.cloud_head.stamp = stamp;
+  bufs.cloud_head.frame_id = cfg->sensor_frame;
+  const std_msgs::Header& head = bufs.head;
+  const std_msgs::Header& cloud_head = bufs.cloud_head;
+
+  // REP 104: an all zero roi stands for the full resolution
+  sensor_msgs::RegionOfInterest info_roi;
+  if ((data->width != data->full_width) ||
+      (data->height != data->full_height)) {
+    info_roi = data->roi;
+  }
 
   //
-  // Publish the intrinsic calibration params.
+  // The intrinsic calibration params.
   // REP 104 suggests publishing the intrinsics with every frame
   // see: http://www.ros.org/reps/rep-0104.html
   //
-  {
-    std::lock_guard<std::mutex> lock(this->intrinsic_mutex_);
-    this->intrinsic_msg_.header = head;
-    try {
-      this->intrinsic_pubs_.at(idx).publish(this->intrinsic_msg_);
-    } catch (const std::out_of_range& ex) {
-      NODELET_ERROR_STREAM("Could not publish intrinsics: " << ex.what());
-    }
+  if (want.info) {
+    products.info = bufs.info_msgs.Acquire();
+    *products.info = cfg->intrinsics;
+    products.info->header = head;
+    products.info->roi = info_roi;
+  }
+
+  // REP 104: the binned products keep the full-resolution calibration and
+  // flag the binning
+  if (want.binned_info) {
+    products.binned_info = bufs.binned_info_msgs.Acquire();
+    *products.binned_info = cfg->intrinsics;
+    products.binned_info->header = head;
+    products.binned_info->roi = info_roi;
+    products.binned_info->binning_x = cfg->bin;
+    products.binned_info->binning_y = cfg->bin;
   }
 
   //
   // Exposure times
   //
-  argus_ros::ExposureTimes exposure_msg;
-  exposure_msg.header = head;
-  std::copy(data->exposureTimes.begin(), data->exposureTimes.end(),
-            std::back_inserter(exposure_msg.usec));
-  try {
-    auto& ex_pub = this->exposure_pubs_.at(idx);
-    ex_pub.publish(exposure_msg);
-  } catch (const std::out_of_range& ex) {
-    NODELET_ERROR_STREAM("Could not publish exposures: " << ex.what());
+  if (want.exposure) {
+    products.exposure = bufs.exposure_msgs.Acquire();
+    products.exposure->header = head;
+    products.exposure->usec.assign(data->exposureTimes.begin(),
+                                   data->exposureTimes.end());
+  }
+
+  // the pixel loop is only needed if at least one image or the cloud is wanted
+  if (!(want.gray || want.conf || want.noise || want.xyz || want.depth ||
+        want.depth_mm || want.cloud || want.compact || want.voxel ||
+        want.normals || want_scan || want.binned_depth ||
+        want.binned_cloud)) {
+    return want.info || want.exposure || want.binned_info;
+  }
+
+  // the validity gates, shared by the filters and the conversion
+  argus_ros::FrameInputs in;
+  in.points = data->points.data();
+  in.width = data->width;
+  in.height = data->height;
+  if (cfg->mask && (cfg->mask_width == data->full_width) &&
+      (cfg->mask_height == data->full_height) &&
+      (cfg->mask->width == data->width) &&
+      (cfg->mask->height == data->height)) {
+    in.mask = cfg->mask.get();
   }
+  in.min_confidence = cfg->min_confidence;
+  in.min_range = cfg->min_range;
+  in.max_range = cfg->max_range;
+  in.max_noise = cfg->max_noise;
 
   //
-  // Loop over the pixel data and publish the images
+  // Spatial, then temporal denoising, done on the points so that every
+  // product derived from the depth sees the filtered values
   //
-  pcl::PointCloud<pcl::PointXYZI>::Ptr
-      cloud_(new pcl::PointCloud<pcl::PointXYZI>());
-
-  cv::Mat gray_, conf_, noise_, xyz_, uvec_, depth_;
-  gray_.create(data->height, data->width, CV_16UC1);
-  conf_.create(data->height, data->width, CV_8UC1);
-  noise_.create(data->height, data->width, CV_32FC1);
-  xyz_.create(data->height, data->width, CV_32FC3);
-  depth_.create(data->height, data->width, CV_32FC1);
-  uvec_.create(uvec_data_->height, uvec_data_->width, CV_32FC3);
-
-  std::uint16_t* gray_ptr = NULL;
-  std::uint8_t* conf_ptr = NULL;
-  float* noise_ptr = NULL;
-  float* xyz_ptr = NULL;
-  float* depth_ptr = NULL;
-  float* uvec_ptr = NULL;
-
-  std::size_t npts = data->points.size();
-  int col = 0;
-  int uv_col = 0;
-  int row = -1;
-  int xyz_col = 0;
-
-  cloud_->width = data->width;
-  cloud_->height = data->height;
-  cloud_->is_dense = true;
-  cloud_->points.resize(npts);
-
-  for (std::size_t i = 0; i < npts; ++i) {
-    pcl::PointXYZI& pt = cloud_->points[i];
-
-    col = i % data->width;
-    uv_col = (3 * i) % data->width;
-    xyz_col = col * 3;
-
-    if (col == 0) {
-      row += 1;
-      gray_ptr = gray_.ptr<std::uint16_t>(row);
-      conf_ptr = conf_.ptr<std::uint8_t>(row);
-      noise_ptr = noise_.ptr<float>(row);
-      xyz_ptr = xyz_.ptr<float>(row);
-
-      //-------------- BNR -----------/
-      depth_ptr = depth_.ptr<float>(row);
-      uvec_ptr = uvec_.ptr<float>(row);
-      //------------------------------/
-    }
+  bufs.spatial.Apply(cfg->spatial, frame.points.data(), data->width,
+                     data->height);
+  if ((bufs.temporal_use_case != cfg->use_case) ||
+      (bufs.temporal_x_offset != data->roi.x_offset) ||
+      (bufs.temporal_y_offset != data->roi.y_offset)) {
+    bufs.temporal.Reset();
+    bufs.temporal_use_case = cfg->use_case;
+    bufs.temporal_x_offset = data->roi.x_offset;
+    bufs.temporal_y_offset = data->roi.y_offset;
+  }
+  bufs.temporal.Apply(cfg->temporal, in, frame.points.data());
 
-    gray_ptr[col] = data->points[i].grayValue;
-    conf_ptr[col] = data->points[i].depthConfidence;
-    noise_ptr[col] = data->points[i].noise;
+  //
+  // Convert the pixel data straight into the requested outgoing messages
+  //
+  sensor_msgs::ImagePtr gray_msg, conf_msg, noise_msg, xyz_msg, depth_msg,
+      depth_mm_msg;
+  if (want.gray) {
+    gray_msg = PrepareImage(head, enc::TYPE_16UC1, data->width, data->height,
+                            sizeof(std::uint16_t), bufs.gray_msgs);
+  }
+  if (want.conf) {
+    conf_msg = PrepareImage(head, enc::TYPE_8UC1, data->width, data->height,
+                            sizeof(std::uint8_t), bufs.conf_msgs);
+  }
+  if (want.noise) {
+    noise_msg = PrepareImage(head, enc::TYPE_32FC1, data->width, data->height,
+                             sizeof(float), bufs.noise_msgs);
+  }
+  if (want.xyz) {
+    xyz_msg = PrepareImage(cloud_head, enc::TYPE_32FC3, data->width,
+                           data->height, 3 * sizeof(float), bufs.xyz_msgs);
+  }
+  if (want.depth) {
+    depth_msg = PrepareImage(cloud_head, enc::TYPE_32FC1, data->width,
+                             data->height, sizeof(float), bufs.depth_msgs);
+  }
+  if (want.depth_mm) {
+    // REP 118 depth images share the header of the camera_info
+    depth_mm_msg = PrepareImage(head, enc::TYPE_16UC1, data->width,
+                                data->height, sizeof(std::uint16_t),
+                                bufs.depth_mm_msgs);
+  }
 
-    //-------------- BNR -----------/
-    uvec_ptr[uv_col] = uvec_data_->points[i].x;
-    uv_col++;
-    uvec_ptr[uv_col] = uvec_data_->points[i].y;
-    uv_col++;
-    uvec_ptr[uv_col] = uvec_data_->points[i].z;
-
-    if (conf_ptr[col] > 0) {
-      // convert to sensor frame
-      pt.x = data->points[i].z;
-      pt.y = -data->points[i].x;
-      pt.z = -data->points[i].y;
-      depth_ptr[col] = data->points[i].z;
-      pt.data_c[0] = pt.data_c[1] = pt.data_c[2] = pt.data_c[3] = 0;
-      pt.intensity = data->points[i].grayValue;
-    } else {
-      pt.x = std::numeric_limits<float>::quiet_NaN();
-      pt.y = std::numeric_limits<float>::quiet_NaN();
-      pt.z = std::numeric_limits<float>::quiet_NaN();
-      pt.intensity = std::numeric_limits<float>::quiet_NaN();
-      depth_ptr[col] = 0.0f;
-    }
+  // the organized cloud keeps NaNs for invalid pixels, so it is not dense
+  sensor_msgs::PointCloud2Ptr cloud_msg, compact_msg, voxel_msg;
+  if (want.cloud) {
+    cloud_msg = PrepareCloud(cloud_head, data->width, data->height,
+                             cfg->cloud_layout, false, bufs.cloud_msgs);
+  }
+  if (want.compact) {
+    // sized for every pixel being valid, trimmed after the conversion
+    compact_msg = PrepareCloud(cloud_head, data->width * data->height, 1,
+                               cfg->cloud_layout, true, bufs.compact_msgs);
+    bufs.compact_counts.resize(data->height);
+  }
+  if (want.voxel) {
+    // at most one point per pixel, trimmed after the reduction
+    voxel_msg = PrepareCloud(cloud_head, data->width * data->height, 1,
+                             argus_ros::CloudLayout::XYZI, true,
+                             bufs.voxel_msgs);
+  }
 
-    if (image_mask_loaded_) {
-      if (image_mask_.at<float>(col, row) > DEPTH_THRESH) {
-        depth_ptr[col] = 0.0f;
-        pt.x = std::numeric_limits<float>::quiet_NaN();
-        pt.y = std::numeric_limits<float>::quiet_NaN();
-        pt.z = std::numeric_limits<float>::quiet_NaN();
-        pt.intensity = std::numeric_limits<float>::quiet_NaN();
-      }
-    }
-    //------------------------------/
+  // normal x, y, z and curvature, in the frame of the cloud
+  sensor_msgs::ImagePtr normals_msg;
+  if (want.normals) {
+    normals_msg = PrepareImage(cloud_head, enc::TYPE_32FC4, data->width,
+                               data->height, 4 * sizeof(float),
+                               bufs.normals_msgs);
+  }
 
-    xyz_ptr[xyz_col] = pt.x;
-    xyz_ptr[xyz_col + 1] = pt.y;
-    xyz_ptr[xyz_col + 2] = pt.z;
+  sensor_msgs::ImagePtr binned_depth_msg;
+  sensor_msgs::PointCloud2Ptr binned_cloud_msg;
+  if (want.binned_depth) {
+    binned_depth_msg = PrepareImage(head, enc::TYPE_32FC1,
+                                    data->width / cfg->bin,
+                                    data->height / cfg->bin, sizeof(float),
+                                    bufs.binned_depth_msgs);
+  }
+  if (want.binned_cloud) {
+    binned_cloud_msg = PrepareCloud(cloud_head, data->width / cfg->bin,
+                                    data->height / cfg->bin,
+                                    argus_ros::CloudLayout::XYZI, false,
+                                    bufs.binned_cloud_msgs);
   }
 
-  //
-  // Create the image messages
-  //
-  sensor_msgs::ImagePtr gray_msg =
-      cv_bridge::CvImage(head, enc::TYPE_16UC1, gray_).toImageMsg();
-  sensor_msgs::ImagePtr conf_msg =
-      cv_bridge::CvImage(head, enc::TYPE_8UC1, conf_).toImageMsg();
-  sensor_msgs::ImagePtr noise_msg =
-      cv_bridge::CvImage(head, enc::TYPE_32FC1, noise_).toImageMsg();
-  cloud_->header = pcl_conversions::toPCL(cloud_head);
-  sensor_msgs::ImagePtr xyz_msg =
-      cv_bridge::CvImage(cloud_head, enc::TYPE_32FC3, xyz_).toImageMsg();
+  argus_ros::FrameOutputs out;
+  if (want.gray) {
+    out.gray = gray_msg->data.data();
+    out.gray_step = gray_msg->step;
+  }
+  if (want.conf) {
+    out.conf = conf_msg->data.data();
+    out.conf_step = conf_msg->step;
+  }
+  if (want.noise) {
+    out.noise = noise_msg->data.data();
+    out.noise_step = noise_msg->step;
+  }
+  if (want.xyz) {
+    out.xyz = xyz_msg->data.data();
+    out.xyz_step = xyz_msg->step;
+  }
+  if (want.depth) {
+    out.depth = depth_msg->data.data();
+    out.depth_step = depth_msg->step;
+  }
+  if (want.depth_mm) {
+    out.depth_mm = depth_mm_msg->data.data();
+    out.depth_mm_step = depth_mm_msg->step;
+    out.depth_mm_min = cfg->depth_mm_min;
+    out.depth_mm_max = cfg->depth_mm_max;
+  }
+  out.cloud_layout = cfg->cloud_layout;
+  if (want.cloud) {
+    out.cloud = cloud_msg->data.data();
+  }
+  if (want.compact) {
+    out.compact = compact_msg->data.data();
+    out.compact_counts = bufs.compact_counts.data();
+  }
+  out.bin = cfg->bin;
+  out.bin_method = cfg->bin_method;
+  if (want.binned_depth) {
+    out.binned_depth = binned_depth_msg->data.data();
+    out.binned_depth_step = binned_depth_msg->step;
+  }
+  if (want.binned_cloud) {
+    out.binned_cloud = binned_cloud_msg->data.data();
+  }
 
-  //-------------- BNR -----------/
-  sensor_msgs::ImagePtr depth_msg =
-      cv_bridge::CvImage(cloud_head, sensor_msgs::image_encodings::TYPE_32FC1, depth_).toImageMsg();
-  sensor_msgs::ImagePtr uvec_msg =
-      cv_bridge::CvImage(head, sensor_msgs::image_encodings::TYPE_32FC3, uvec_).toImageMsg();
-  sensor_msgs::ImagePtr image_mask_msg;
-  if (image_mask_loaded_)
-    image_mask_msg = cv_bridge::CvImage(cloud_head,
-                                        sensor_msgs::image_encodings::TYPE_32FC1, image_mask_)
-                         .toImageMsg();
-  //------------------------------/
+  this->pool_->ForEachBand(data->height, [&in, &out](int r0, int r1) {
+    argus_ros::ConvertRows(in, out, r0, r1);
+  });
 
-  //
-  // Publish the data
-  //
-  try {
-    this->gray_pubs_.at(idx).publish(gray_msg);
-    this->conf_pubs_.at(idx).publish(conf_msg);
-    this->noise_pubs_.at(idx).publish(noise_msg);
-    this->cloud_pubs_.at(idx).publish(cloud_);
-    this->xyz_pubs_.at(idx).publish(xyz_msg);
+  if (want.compact) {
+    std::size_t npts = argus_ros::CompactRows(in, out);
+    compact_msg->width = npts;
+    compact_msg->row_step = npts * compact_msg->point_step;
+    compact_msg->data.resize(compact_msg->row_step);
+  }
 
-    //-------------- BNR -----------/
-    this->depth_pubs_.at(idx).publish(depth_msg);
-    this->unit_vec_pubs_.at(idx).publish(uvec_msg);
-    if (image_mask_loaded_)
-      image_mask_pub_.publish(image_mask_msg);
-    //------------------------------/
-  } catch (const std::out_of_range& ex) {
-    // If this happens, it is a bug.
-    NODELET_ERROR_STREAM("Could not publish image message: " << ex.what());
+  if (want.voxel) {
+    std::size_t npts =
+        bufs.voxels.Reduce(in, cfg->voxel, voxel_msg->data.data());
+    voxel_msg->width = npts;
+    voxel_msg->row_step = npts * voxel_msg->point_step;
+    voxel_msg->data.resize(voxel_msg->row_step);
   }
+
+  if (want.normals) {
+    // the bands reach everything through one reference, which keeps the
+    // lambda small enough for std::function to store it without allocating
+    struct {
+      argus_ros::NormalEstimator* normals;
+      const argus_ros::FrameInputs* in;
+      int window;
+      std::uint8_t* dst;
+      std::size_t step;
+    } job = {&bufs.normals, &in, cfg->normal_window,
+             normals_msg->data.data(), normals_msg->step};
+
+    // the summed-area table (80 bytes per pixel) is built in two banded
+    // passes, along the rows and then down the columns
+    bufs.normals.Prepare(in);
+    this->pool_->ForEachBand(data->height, [&job](int r0, int r1) {
+      job.normals->IntegrateRows(*job.in, r0, r1);
+    });
+    this->pool_->ForEachBand(data->width, [&job](int c0, int c1) {
+      job.normals->IntegrateColumns(c0, c1);
+    });
+    this->pool_->ForEachBand(data->height, [&job](int r0, int r1) {
+      job.normals->Rows(*job.in, job.window, r0, r1, job.dst, job.step);
+    });
+  }
+
+  products.gray = std::move(gray_msg);
+  products.conf = std::move(conf_msg);
+  products.noise = std::move(noise_msg);
+  products.xyz = std::move(xyz_msg);
+  products.depth = std::move(depth_msg);
+  products.depth_mm = std::move(depth_mm_msg);
+  products.cloud = std::move(cloud_msg);
+  products.compact_cloud = std::move(compact_msg);
+  products.voxel_cloud = std::move(voxel_msg);
+  products.normals = std::move(normals_msg);
+
+  if (want_scan) {
+    const argus_ros::ScanTable& table = *cfg->scan_table;
+    products.scan = bufs.scan_msgs.Acquire();
+    sensor_msgs::LaserScan& scan = *products.scan;
+    scan.header = cloud_head;
+    scan.angle_min = table.angle_min;
+    scan.angle_max =
+        table.angle_min + (table.nbins - 1) * table.angle_increment;
+    scan.angle_increment = table.angle_increment;
+    scan.time_increment = 0.f;
+    scan.scan_time = 0.f;
+    scan.range_min = cfg->scan.range_min;
+    scan.range_max = cfg->scan.range_max;
+    scan.ranges.resize(table.nbins);
+    scan.intensities.clear();
+
+    // one band of rows per thread, each into its own set of bins, merged
+    // afterwards
+    int nbands = std::min(static_cast<int>(this->pool_->Size()) + 1,
+                          static_cast<int>(data->height));
+    bufs.scan_bands.resize(static_cast<std::size_t>(nbands) * table.nbins);
+    struct {
+      const argus_ros::FrameInputs* in;
+      const argus_ros::ScanTable* table;
+      const argus_ros::ScanParams* params;
+      float* sq;
+      int nbands;
+    } job = {&in, &table, &cfg->scan, bufs.scan_bands.data(), nbands};
+    this->pool_->ForEachBand(nbands, [&job](int b0, int b1) {
+      for (int b = b0; b < b1; ++b) {
+        argus_ros::ScanRows(*job.in, *job.table, *job.params,
+                            b * job.in->height / job.nbands,
+                            (b + 1) * job.in->height / job.nbands,
+                            job.sq + b * job.table->nbins);
+      }
+    });
+    argus_ros::MergeScan(bufs.scan_bands.data(), nbands, table.nbins,
+                         scan.ranges.data());
+  }
+  products.binned_depth = std::move(binned_depth_msg);
+  products.binned_cloud = std::move(binned_cloud_msg);
+
+  // more messages in flight than the pools retain, e.g., held by slow
+  // intra-process subscribers
+  std::size_t misses = bufs.PoolMisses();
+  if (misses != bufs.reported_misses) {
+    NODELET_WARN_STREAM_THROTTLE(5, "Stream " << idx + 1 << " allocated "
+                                 << misses << " messages outside of its "
+                                 << "message pools, consider raising "
+                                 << "~message_pool_size (now "
+                                 << bufs.pool_size << ")");
+    bufs.reported_misses = misses;
+  }
+  return true;
+}
+
+std::size_t argus_ros::CameraNodelet::StreamBuffers::PoolMisses() const {
+  return this->gray_msgs.Misses() + this->conf_msgs.Misses() +
+         this->noise_msgs.Misses() + this->xyz_msgs.Misses() +
+         this->depth_msgs.Misses() + this->depth_mm_msgs.Misses() +
+         this->cloud_msgs.Misses() + this->compact_msgs.Misses() +
+         this->voxel_msgs.Misses() + this->normals_msgs.Misses() +
+         this->scan_msgs.Misses() + this->exposure_msgs.Misses() +
+         this->info_msgs.Misses() + this->binned_depth_msgs.Misses() +
+         this->binned_cloud_msgs.Misses() + this->binned_info_msgs.Misses();
 }
 
 //-------------- BNR -----------/
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Throughput and compression ratio of the "lossless" transport codecs on
+// synthetic ToF frames (a tilted wall with a box in front of it, sensor
+// noise and invalid pixels), next to PNG and plain LZ4 as baselines.
+//
+// usage: argus_ros_codec_bench [width height [iterations]]
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <argus_ros/depth_codec.h>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+struct Scene {
+  int width;
+  int height;
+  std::vector<float> xyz;          // 32FC3, NaN where invalid
+  std::vector<float> depth;        // 32FC1, NaN where invalid
+  std::vector<std::uint16_t> mm;   // 16UC1, 0 where invalid
+};
+
+Scene MakeScene(int width, int height) {
+  Scene s;
+  s.width = width;
+  s.height = height;
+  s.xyz.resize(width * height * 3);
+  s.depth.resize(width * height);
+  s.mm.resize(width * height);
+
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.f, 0.004f);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  for (int r = 0; r < height; ++r) {
+    for (int c = 0; c < width; ++c) {
+      float u = (c - width / 2.f) / width;
+      float v = (r - height / 2.f) / height;
+      float z = 2.f + 0.8f * u;
+      if ((std::fabs(u) < 0.15f) && (std::fabs(v) < 0.2f)) {
+        z = 1.2f;
+      }
+      z += noise(rng);
+
+      // dark corners and a few flying pixels
+      bool valid = (u * u + v * v < 0.28f) && (uniform(rng) > 0.03f);
+
+      int i = r * width + c;
+      s.depth[i] = valid ? z : nan;
+      s.xyz[3 * i + 0] = valid ? u * z : nan;
+      s.xyz[3 * i + 1] = valid ? v * z : nan;
+      s.xyz[3 * i + 2] = valid ? z : nan;
+      s.mm[i] = valid ? static_cast<std::uint16_t>(std::lround(z * 1000.f)) : 0;
+    }
+  }
+  return s;
+}
+
+void Report(const std::string& name, std::size_t raw, int iterations,
+            const std::function<std::size_t()>& encode,
+            const std::function<bool()>& decode) {
+  std::size_t packed = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    packed = encode();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  bool ok = true;
+  for (int i = 0; i < iterations; ++i) {
+    ok = decode() && ok;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  double mb = static_cast<double>(raw) * iterations / (1024. * 1024.);
+  double enc_s = std::chrono::duration<double>(t1 - t0).count();
+  double dec_s = std::chrono::duration<double>(t2 - t1).count();
+
+  std::cout << std::left << std::setw(22) << name << std::right
+            << std::setw(10) << raw << std::setw(10) << packed
+            << std::fixed << std::setprecision(2) << std::setw(8)
+            << static_cast<double>(raw) / std::max<std::size_t>(packed, 1)
+            << std::setprecision(0) << std::setw(12) << mb / enc_s
+            << std::setw(12) << mb / dec_s
+            << (ok ? "" : "  ROUND TRIP FAILED") << std::endl;
+}
+
+}  // end: anonymous namespace
+
+int main(int argc, const char** argv) {
+  int width = (argc > 2) ? std::atoi(argv[1]) : 224;
+  int height = (argc > 2) ? std::atoi(argv[2]) : 172;
+  int iterations = (argc > 3) ? std::atoi(argv[3]) : 200;
+  if ((width <= 0) || (height <= 0) || (iterations <= 0)) {
+    std::cerr << "usage: " << argv[0] << " [width height [iterations]]"
+              << std::endl;
+    return 1;
+  }
+
+  Scene s = MakeScene(width, height);
+  std::size_t npix = static_cast<std::size_t>(width) * height;
+  std::vector<std::uint8_t> packed, scratch;
+
+  std::cout << width << "x" << height << ", " << iterations
+            << " iterations" << std::endl;
+  std::cout << std::left << std::setw(22) << "codec" << std::right
+            << std::setw(10) << "raw B" << std::setw(10) << "packed B"
+            << std::setw(8) << "ratio" << std::setw(12) << "enc MB/s"
+            << std::setw(12) << "dec MB/s" << std::endl;
+
+  //
+  // 16UC1 millimeter depth
+  //
+  std::vector<std::uint16_t> mm_out(npix);
+  Report("16UC1 rvl", npix * 2, iterations,
+         [&] {
+           argus_ros::EncodeRVL(s.mm.data(), npix, packed);
+           return packed.size();
+         },
+         [&] {
+           return argus_ros::DecodeRVL(packed.data(), packed.size(),
+                                       mm_out.data(), npix) &&
+                  (mm_out == s.mm);
+         });
+
+  cv::Mat mm_img(height, width, CV_16UC1, s.mm.data());
+  Report("16UC1 png", npix * 2, iterations,
+         [&] {
+           cv::imencode(".png", mm_img, packed);
+           return packed.size();
+         },
+         [&] {
+           cv::Mat dec = cv::imdecode(packed, cv::IMREAD_UNCHANGED);
+           return !dec.empty() &&
+                  (std::memcmp(dec.data, s.mm.data(), npix * 2) == 0);
+         });
+
+  //
+  // 32FC1 depth and 32FC3 xyz
+  //
+  struct FloatImage {
+    std::string name;
+    const std::vector<float>* data;
+  };
+  for (const FloatImage& img :
+       {FloatImage{"32FC1", &s.depth}, FloatImage{"32FC3", &s.xyz}}) {
+    std::size_t n = img.data->size();
+    const std::uint8_t* raw =
+        reinterpret_cast<const std::uint8_t*>(img.data->data());
+    std::vector<float> out(n);
+    std::uint8_t* out_bytes = reinterpret_cast<std::uint8_t*>(out.data());
+
+    for (std::size_t elem_size : {std::size_t(4), std::size_t(1)}) {
+      Report(img.name + (elem_size > 1 ? " shuffle+lz4" : " lz4"), n * 4,
+             iterations,
+             [&] {
+               argus_ros::EncodeShuffleLZ4(raw, n * 4 / elem_size, elem_size,
+                                           packed, scratch);
+               return packed.size();
+             },
+             [&] {
+               return argus_ros::DecodeShuffleLZ4(
+                          packed.data(), packed.size(), out_bytes,
+                          n * 4 / elem_size, elem_size, scratch) &&
+                      (std::memcmp(out_bytes, raw, n * 4) == 0);
+             });
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,662 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/conversion.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <argus.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ARGUS_ROS_SSE41_KERNEL 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ARGUS_ROS_NEON_KERNEL 1
+#endif
+
+namespace {
+using argus_ros::CloudLayout;
+
+// The vector kernels pull (x, y, z, noise) of a point in as one 4-lane load
+static_assert(offsetof(argus::DepthPoint, x) == 0 &&
+                  offsetof(argus::DepthPoint, y) == 4 &&
+                  offsetof(argus::DepthPoint, z) == 8 &&
+                  offsetof(argus::DepthPoint, noise) == 12,
+              "Unexpected argus::DepthPoint layout");
+
+const float NaN_ = std::numeric_limits<float>::quiet_NaN();
+
+//
+// Per-row view of the inputs and outputs; plane pointers are nullptr when the
+// channel is not requested
+//
+struct RowArgs {
+  const argus::DepthPoint* pts;
+  const std::uint64_t* mask_bits;
+  int width;
+
+  // validity gates (see argus_ros::FrameInputs), the range is finite so
+  // that it also rules out infinite depths
+  std::uint8_t min_conf;
+  float min_range;
+  float max_range;
+  float max_noise;
+
+  std::uint16_t* gray;
+  std::uint8_t* conf;
+  float* noise;
+  float* xyz;
+  float* depth;
+  std::uint16_t* depth_mm;
+  float mm_min;
+  float mm_max;
+  std::uint8_t* cloud;
+  std::size_t cloud_step;
+  CloudLayout cloud_layout;
+
+  // valid points only, packed from the start of the row; the number written
+  // is stored to `compact_count`
+  std::uint8_t* compact;
+  std::uint32_t* compact_count;
+};
+
+typedef void (*RowKernel)(const RowArgs&);
+
+// Reference implementation, converts columns [col, width). `n` is the number
+// of compact points the caller already wrote for this row.
+void ScalarTail(const RowArgs& r, int col, std::uint32_t n) {
+  for (int c = col; c < r.width; ++c) {
+    const argus::DepthPoint& p = r.pts[c];
+    bool valid = (p.depthConfidence >= r.min_conf) && std::isfinite(p.x) &&
+                 std::isfinite(p.y) && (p.z >= r.min_range) &&
+                 (p.z <= r.max_range) && (p.noise <= r.max_noise);
+    if ((r.mask_bits != nullptr) && ((r.mask_bits[c >> 6] >> (c & 63)) & 1)) {
+      valid = false;
+    }
+
+    if (r.gray) r.gray[c] = p.grayValue;
+    if (r.conf) r.conf[c] = p.depthConfidence;
+    if (r.noise) r.noise[c] = p.noise;
+    if (r.depth) r.depth[c] = valid ? p.z : 0.f;
+    if (r.depth_mm) {
+      // rounds to nearest even, like the vector kernels
+      float mm = std::nearbyint(p.z * 1000.f);
+      r.depth_mm[c] =
+          (valid && (p.z >= r.mm_min) && (p.z <= r.mm_max)) ?
+          static_cast<std::uint16_t>(std::min(std::max(mm, 0.f), 65535.f)) :
+          0;
+    }
+
+    if (!(r.xyz || r.cloud || r.compact)) {
+      continue;
+    }
+
+    // convert to sensor frame
+    float sx = valid ? p.z : NaN_;
+    float sy = valid ? -p.x : NaN_;
+    float sz = valid ? -p.y : NaN_;
+    if (r.xyz) {
+      float* q = r.xyz + 3 * c;
+      q[0] = sx;
+      q[1] = sy;
+      q[2] = sz;
+    }
+
+    const float pt[4] = {
+        sx, sy, sz, valid ? static_cast<float>(p.grayValue) : NaN_};
+    std::uint8_t* dst[2] = {
+        r.cloud ? r.cloud + c * r.cloud_step : nullptr,
+        (r.compact && valid) ? r.compact + (n++) * r.cloud_step : nullptr};
+    for (std::uint8_t* q : dst) {
+      if (q == nullptr) {
+        continue;
+      }
+      std::memcpy(q, pt, r.cloud_layout == CloudLayout::XYZ ? 12 : 16);
+      if (r.cloud_layout == CloudLayout::XYZINC) {
+        std::memcpy(q + 16, &p.noise, sizeof(float));
+        q[20] = p.depthConfidence;
+      }
+    }
+  }
+
+  if (r.compact) {
+    *r.compact_count = n;
+  }
+}
+
+void ScalarRow(const RowArgs& r) { ScalarTail(r, 0, 0); }
+
+// Invalidates the given masked pixels of a row converted without its mask
+void PatchMasked(const RowArgs& r, const std::uint32_t* first,
+                 const std::uint32_t* last, std::uint32_t row_start) {
+  const std::size_t ncloud = (r.cloud_layout == CloudLayout::XYZ) ? 3 : 4;
+  for (; first != last; ++first) {
+    std::size_t c = *first - row_start;
+    if (r.depth) r.depth[c] = 0.f;
+    if (r.depth_mm) r.depth_mm[c] = 0;
+    if (r.xyz) {
+      std::fill(r.xyz + 3 * c, r.xyz + 3 * c + 3, NaN_);
+    }
+    if (r.cloud) {
+      const float nan4[4] = {NaN_, NaN_, NaN_, NaN_};
+      std::memcpy(r.cloud + c * r.cloud_step, nan4, ncloud * sizeof(float));
+    }
+  }
+}
+
+// Produces binned row `brow` from the (bin x bin) pixel blocks it covers
+void BinRow(const argus_ros::FrameInputs& in,
+            const argus_ros::FrameOutputs& out, int brow) {
+  const int bin = out.bin;
+  const int bwidth = in.width / bin;
+  float* depth = out.binned_depth ?
+      reinterpret_cast<float*>(out.binned_depth +
+                               brow * out.binned_depth_step) :
+      nullptr;
+  float* cloud = out.binned_cloud ?
+      reinterpret_cast<float*>(out.binned_cloud) + 4 * brow * bwidth :
+      nullptr;
+
+  const argus::DepthPoint* valid[argus_ros::MAX_BIN * argus_ros::MAX_BIN];
+  auto closer = [](const argus::DepthPoint* a, const argus::DepthPoint* b) {
+    return a->z < b->z;
+  };
+
+  for (int bcol = 0; bcol < bwidth; ++bcol) {
+    int n = 0;
+    for (int row = brow * bin; row < (brow + 1) * bin; ++row) {
+      const argus::DepthPoint* pts = in.points + row * in.width;
+      for (int c = bcol * bin; c < (bcol + 1) * bin; ++c) {
+        if (argus_ros::IsValidPixel(in, row, c)) {
+          valid[n++] = pts + c;
+        }
+      }
+    }
+
+    // optical frame x, y, z and intensity
+    float pt[4] = {NaN_, NaN_, NaN_, NaN_};
+    if (n > 0) {
+      const argus::DepthPoint* p = nullptr;
+      switch (out.bin_method) {
+        case argus_ros::BinMethod::MIN:
+          p = *std::min_element(valid, valid + n, closer);
+          break;
+        case argus_ros::BinMethod::MEDIAN:
+          std::nth_element(valid, valid + (n - 1) / 2, valid + n, closer);
+          p = valid[(n - 1) / 2];
+          break;
+        case argus_ros::BinMethod::MEAN:
+        default:
+          std::fill(pt, pt + 4, 0.f);
+          for (int i = 0; i < n; ++i) {
+            pt[0] += valid[i]->x;
+            pt[1] += valid[i]->y;
+            pt[2] += valid[i]->z;
+            pt[3] += valid[i]->grayValue;
+          }
+          for (float& v : pt) {
+            v /= n;
+          }
+          break;
+      }
+      if (p != nullptr) {
+        pt[0] = p->x;
+        pt[1] = p->y;
+        pt[2] = p->z;
+        pt[3] = p->grayValue;
+      }
+    }
+
+    if (depth) depth[bcol] = (n > 0) ? pt[2] : 0.f;
+    if (cloud) {
+      // convert to sensor frame
+      float* q = cloud + 4 * bcol;
+      q[0] = pt[2];
+      q[1] = -pt[0];
+      q[2] = -pt[1];
+      q[3] = pt[3];
+    }
+  }
+}
+
+//
+// The vector kernels convert 4 pixels per iteration: the AoS points are
+// transposed into x/y/z/noise lanes, validity (the gates of
+// argus_ros::FrameInputs and the 4 mask bits of those pixels) becomes a lane
+// mask, and invalid pixels are blended to NaN/0 without branching. The
+// 3-channel planes (and 12-byte cloud points) are written with overlapping
+// 16-byte stores, so the last column of a row is always left to the scalar
+// tail to keep those stores from spilling into the next row (which may be
+// owned by another thread).
+//
+
+#if defined(ARGUS_ROS_SSE41_KERNEL)
+__attribute__((target("sse4.1"))) void Sse41Row(const RowArgs& r) {
+  const __m128 nan = _mm_set1_ps(NaN_);
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128i conf_floor = _mm_set1_epi32(r.min_conf - 1);
+  const __m128 min_range = _mm_set1_ps(r.min_range);
+  const __m128 max_range = _mm_set1_ps(r.max_range);
+  const __m128 max_noise = _mm_set1_ps(r.max_noise);
+  const __m128 flt_max = _mm_set1_ps(std::numeric_limits<float>::max());
+  const __m128i bit_sel = _mm_setr_epi32(1, 2, 4, 8);
+  const __m128 k1000 = _mm_set1_ps(1000.f);
+  const __m128 mm_min = _mm_set1_ps(r.mm_min);
+  const __m128 mm_max = _mm_set1_ps(r.mm_max);
+
+  std::uint32_t n = 0;
+  int c = 0;
+  for (; c + 4 < r.width; c += 4) {
+    const argus::DepthPoint* p = r.pts + c;
+    __m128 vx = _mm_loadu_ps(&p[0].x);
+    __m128 vy = _mm_loadu_ps(&p[1].x);
+    __m128 vz = _mm_loadu_ps(&p[2].x);
+    __m128 vn = _mm_loadu_ps(&p[3].x);
+    _MM_TRANSPOSE4_PS(vx, vy, vz, vn);
+
+    __m128i conf = _mm_setr_epi32(p[0].depthConfidence, p[1].depthConfidence,
+                                  p[2].depthConfidence, p[3].depthConfidence);
+    __m128i gray = _mm_setr_epi32(p[0].grayValue, p[1].grayValue,
+                                  p[2].grayValue, p[3].grayValue);
+
+    // ordered compares, so NaNs fail the gates; |x| <= FLT_MAX rules out
+    // infinities too
+    __m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(conf, conf_floor));
+    valid = _mm_and_ps(
+        valid, _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(sign, vx), flt_max),
+                          _mm_cmple_ps(_mm_andnot_ps(sign, vy), flt_max)));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(vz, min_range),
+                                         _mm_cmple_ps(vz, max_range)));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(vn, max_noise));
+    if (r.mask_bits) {
+      // c is a multiple of 4, so the 4 bits never straddle two words
+      int bits = static_cast<int>((r.mask_bits[c >> 6] >> (c & 63)) & 0xF);
+      __m128i mb = _mm_and_si128(_mm_set1_epi32(bits), bit_sel);
+      valid = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(mb, bit_sel)),
+                            valid);
+    }
+
+    if (r.gray) {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(r.gray + c),
+                       _mm_packus_epi32(gray, gray));
+    }
+    if (r.conf) {
+      __m128i c16 = _mm_packus_epi32(conf, conf);
+      std::int32_t c8 = _mm_cvtsi128_si32(_mm_packus_epi16(c16, c16));
+      std::memcpy(r.conf + c, &c8, sizeof(c8));
+    }
+    if (r.noise) _mm_storeu_ps(r.noise + c, vn);
+    if (r.depth) _mm_storeu_ps(r.depth + c, _mm_and_ps(valid, vz));
+    if (r.depth_mm) {
+      // out of range (or NaN) depths become 0, packus saturates the rest
+      __m128 keep = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(vz, mm_min),
+                                                 _mm_cmple_ps(vz, mm_max)));
+      __m128i mm = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(vz, k1000)),
+                                 _mm_castps_si128(keep));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(r.depth_mm + c),
+                       _mm_packus_epi32(mm, mm));
+    }
+
+    if (!(r.xyz || r.cloud || r.compact)) {
+      continue;
+    }
+
+    // sensor frame: (z, -x, -y), transposed back to one (x, y, z, intensity)
+    // vector per point
+    int valid_bits = _mm_movemask_ps(valid);
+    __m128 sx = _mm_blendv_ps(nan, vz, valid);
+    __m128 sy = _mm_blendv_ps(nan, _mm_xor_ps(vx, sign), valid);
+    __m128 sz = _mm_blendv_ps(nan, _mm_xor_ps(vy, sign), valid);
+    __m128 si = _mm_blendv_ps(nan, _mm_cvtepi32_ps(gray), valid);
+    _MM_TRANSPOSE4_PS(sx, sy, sz, si);
+
+    if (r.xyz) {
+      float* q = r.xyz + 3 * c;
+      _mm_storeu_ps(q, sx);
+      _mm_storeu_ps(q + 3, sy);
+      _mm_storeu_ps(q + 6, sz);
+      _mm_storeu_ps(q + 9, si);
+    }
+    if (r.cloud) {
+      // with the 12-byte layout the 4th lane spills into the next point,
+      // which is rewritten right after
+      std::uint8_t* q = r.cloud + c * r.cloud_step;
+      _mm_storeu_ps(reinterpret_cast<float*>(q), sx);
+      _mm_storeu_ps(reinterpret_cast<float*>(q + r.cloud_step), sy);
+      _mm_storeu_ps(reinterpret_cast<float*>(q + 2 * r.cloud_step), sz);
+      _mm_storeu_ps(reinterpret_cast<float*>(q + 3 * r.cloud_step), si);
+      if (r.cloud_layout == CloudLayout::XYZINC) {
+        for (int k = 0; k < 4; ++k) {
+          std::memcpy(q + k * r.cloud_step + 16, &p[k].noise, sizeof(float));
+          q[k * r.cloud_step + 20] = p[k].depthConfidence;
+        }
+      }
+    }
+    if (r.compact && valid_bits) {
+      const __m128 pts[4] = {sx, sy, sz, si};
+      for (int k = 0; k < 4; ++k) {
+        if (!(valid_bits & (1 << k))) {
+          continue;
+        }
+        std::uint8_t* q = r.compact + (n++) * r.cloud_step;
+        _mm_storeu_ps(reinterpret_cast<float*>(q), pts[k]);
+        if (r.cloud_layout == CloudLayout::XYZINC) {
+          std::memcpy(q + 16, &p[k].noise, sizeof(float));
+          q[20] = p[k].depthConfidence;
+        }
+      }
+    }
+  }
+
+  ScalarTail(r, c, n);
+}
+#endif  // ARGUS_ROS_SSE41_KERNEL
+
+#if defined(ARGUS_ROS_NEON_KERNEL)
+inline void Transpose4(float32x4_t& a, float32x4_t& b,
+                       float32x4_t& c, float32x4_t& d) {
+  float32x4x2_t ab = vtrnq_f32(a, b);
+  float32x4x2_t cd = vtrnq_f32(c, d);
+  a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+void NeonRow(const RowArgs& r) {
+  const float32x4_t nan = vdupq_n_f32(NaN_);
+  const uint32x4_t conf_floor = vdupq_n_u32(r.min_conf - 1);
+  const float32x4_t min_range = vdupq_n_f32(r.min_range);
+  const float32x4_t max_range = vdupq_n_f32(r.max_range);
+  const float32x4_t max_noise = vdupq_n_f32(r.max_noise);
+  const float32x4_t flt_max = vdupq_n_f32(std::numeric_limits<float>::max());
+  const std::uint32_t bit_lanes[4] = {1, 2, 4, 8};
+  const uint32x4_t bit_sel = vld1q_u32(bit_lanes);
+  const float32x4_t mm_min = vdupq_n_f32(r.mm_min);
+  const float32x4_t mm_max = vdupq_n_f32(r.mm_max);
+  const float32x4_t round_magic = vdupq_n_f32(12582912.f);  // 1.5 * 2^23
+  const uint32x4_t round_bits = vreinterpretq_u32_f32(round_magic);
+
+  std::uint32_t n = 0;
+  int c = 0;
+  for (; c + 4 < r.width; c += 4) {
+    const argus::DepthPoint* p = r.pts + c;
+    float32x4_t vx = vld1q_f32(&p[0].x);
+    float32x4_t vy = vld1q_f32(&p[1].x);
+    float32x4_t vz = vld1q_f32(&p[2].x);
+    float32x4_t vn = vld1q_f32(&p[3].x);
+    Transpose4(vx, vy, vz, vn);
+
+    const std::uint32_t conf_lanes[4] = {
+        p[0].depthConfidence, p[1].depthConfidence,
+        p[2].depthConfidence, p[3].depthConfidence};
+    const std::uint32_t gray_lanes[4] = {p[0].grayValue, p[1].grayValue,
+                                         p[2].grayValue, p[3].grayValue};
+    uint32x4_t conf = vld1q_u32(conf_lanes);
+    uint32x4_t gray = vld1q_u32(gray_lanes);
+
+    // NaNs fail the gates; |x| <= FLT_MAX rules out infinities too
+    uint32x4_t valid = vcgtq_u32(conf, conf_floor);
+    valid = vandq_u32(valid, vandq_u32(vcleq_f32(vabsq_f32(vx), flt_max),
+                                       vcleq_f32(vabsq_f32(vy), flt_max)));
+    valid = vandq_u32(valid, vandq_u32(vcgeq_f32(vz, min_range),
+                                       vcleq_f32(vz, max_range)));
+    valid = vandq_u32(valid, vcleq_f32(vn, max_noise));
+    if (r.mask_bits) {
+      // c is a multiple of 4, so the 4 bits never straddle two words
+      std::uint32_t bits =
+          static_cast<std::uint32_t>((r.mask_bits[c >> 6] >> (c & 63)) & 0xF);
+      valid = vbicq_u32(valid, vtstq_u32(vdupq_n_u32(bits), bit_sel));
+    }
+
+    if (r.gray) vst1_u16(r.gray + c, vmovn_u32(gray));
+    if (r.conf) {
+      uint16x4_t c16 = vmovn_u32(conf);
+      uint8x8_t c8 = vmovn_u16(vcombine_u16(c16, c16));
+      std::uint32_t c8w = vget_lane_u32(vreinterpret_u32_u8(c8), 0);
+      std::memcpy(r.conf + c, &c8w, sizeof(c8w));
+    }
+    if (r.noise) vst1q_f32(r.noise + c, vn);
+    if (r.depth) {
+      vst1q_f32(r.depth + c, vreinterpretq_f32_u32(
+                                 vandq_u32(valid, vreinterpretq_u32_f32(vz))));
+    }
+    if (r.depth_mm) {
+      // Adding 1.5 * 2^23 rounds to nearest even (as cvtps does on x86) and
+      // leaves the integer in the low mantissa bits. That holds for all of
+      // [mm_min, mm_max]; out of range (or NaN) depths become 0.
+      uint32x4_t keep = vandq_u32(
+          valid, vandq_u32(vcgeq_f32(vz, mm_min), vcleq_f32(vz, mm_max)));
+      uint32x4_t mm = vsubq_u32(
+          vreinterpretq_u32_f32(vaddq_f32(vmulq_n_f32(vz, 1000.f),
+                                          round_magic)),
+          round_bits);
+      vst1_u16(r.depth_mm + c, vqmovn_u32(vandq_u32(mm, keep)));
+    }
+
+    if (!(r.xyz || r.cloud || r.compact)) {
+      continue;
+    }
+
+    // sensor frame: (z, -x, -y), transposed back to one (x, y, z, intensity)
+    // vector per point
+    std::uint32_t valid_lanes[4];
+    vst1q_u32(valid_lanes, valid);
+    float32x4_t sx = vbslq_f32(valid, vz, nan);
+    float32x4_t sy = vbslq_f32(valid, vnegq_f32(vx), nan);
+    float32x4_t sz = vbslq_f32(valid, vnegq_f32(vy), nan);
+    float32x4_t si = vbslq_f32(valid, vcvtq_f32_u32(gray), nan);
+    Transpose4(sx, sy, sz, si);
+
+    if (r.xyz) {
+      float* q = r.xyz + 3 * c;
+      vst1q_f32(q, sx);
+      vst1q_f32(q + 3, sy);
+      vst1q_f32(q + 6, sz);
+      vst1q_f32(q + 9, si);
+    }
+    if (r.cloud) {
+      // with the 12-byte layout the 4th lane spills into the next point,
+      // which is rewritten right after
+      std::uint8_t* q = r.cloud + c * r.cloud_step;
+      vst1q_f32(reinterpret_cast<float*>(q), sx);
+      vst1q_f32(reinterpret_cast<float*>(q + r.cloud_step), sy);
+      vst1q_f32(reinterpret_cast<float*>(q + 2 * r.cloud_step), sz);
+      vst1q_f32(reinterpret_cast<float*>(q + 3 * r.cloud_step), si);
+      if (r.cloud_layout == CloudLayout::XYZINC) {
+        for (int k = 0; k < 4; ++k) {
+          std::memcpy(q + k * r.cloud_step + 16, &p[k].noise, sizeof(float));
+          q[k * r.cloud_step + 20] = p[k].depthConfidence;
+        }
+      }
+    }
+    if (r.compact) {
+      const float32x4_t pts[4] = {sx, sy, sz, si};
+      for (int k = 0; k < 4; ++k) {
+        if (!valid_lanes[k]) {
+          continue;
+        }
+        std::uint8_t* q = r.compact + (n++) * r.cloud_step;
+        vst1q_f32(reinterpret_cast<float*>(q), pts[k]);
+        if (r.cloud_layout == CloudLayout::XYZINC) {
+          std::memcpy(q + 16, &p[k].noise, sizeof(float));
+          q[20] = p[k].depthConfidence;
+        }
+      }
+    }
+  }
+
+  ScalarTail(r, c, n);
+}
+#endif  // ARGUS_ROS_NEON_KERNEL
+
+std::atomic<RowKernel> row_kernel_(&ScalarRow);
+
+}  // end: anonymous namespace
+
+std::size_t argus_ros::CloudPointStep(argus_ros::CloudLayout layout) {
+  switch (layout) {
+    case CloudLayout::XYZ:
+      return 3 * sizeof(float);
+    case CloudLayout::XYZI:
+      return 4 * sizeof(float);
+    case CloudLayout::XYZINC:
+    default:
+      return 5 * sizeof(float) + sizeof(std::uint8_t);
+  }
+}
+
+argus_ros::PixelMask argus_ros::CompilePixelMask(const float* mask,
+                                                int width, int height,
+                                                std::size_t stride,
+                                                float thresh) {
+  argus_ros::PixelMask m;
+  m.width = width;
+  m.height = height;
+  m.words_per_row = (width + 63) / 64;
+  m.bits.assign(m.words_per_row * height, 0);
+  m.row_offsets.reserve(height + 1);
+
+  for (int row = 0; row < height; ++row) {
+    m.row_offsets.push_back(m.indices.size());
+    std::uint64_t* bits = m.bits.data() + row * m.words_per_row;
+    for (int col = 0; col < width; ++col) {
+      if (mask[col * stride + row] > thresh) {
+        bits[col >> 6] |= std::uint64_t(1) << (col & 63);
+        m.indices.push_back(row * width + col);
+      }
+    }
+  }
+  m.row_offsets.push_back(m.indices.size());
+
+  // Testing the bits costs a little on every pixel, patching costs a few
+  // stores per masked pixel
+  m.sparse = (m.indices.size() * 16) <
+             (static_cast<std::size_t>(width) * height);
+  return m;
+}
+
+std::size_t argus_ros::CompactRows(const argus_ros::FrameInputs& in,
+                                   const argus_ros::FrameOutputs& out) {
+  std::size_t step = argus_ros::CloudPointStep(out.cloud_layout);
+  std::size_t total = 0;
+  for (int row = 0; row < in.height; ++row) {
+    std::size_t off = static_cast<std::size_t>(row) * in.width;
+    std::size_t n = out.compact_counts[row];
+    if ((n > 0) && (total != off)) {
+      std::memmove(out.compact + total * step, out.compact + off * step,
+                   n * step);
+    }
+    total += n;
+  }
+  return total;
+}
+
+const char* argus_ros::SelectConversionKernel(bool allow_simd) {
+#if defined(ARGUS_ROS_SSE41_KERNEL)
+  __builtin_cpu_init();
+  if (allow_simd && __builtin_cpu_supports("sse4.1")) {
+    row_kernel_.store(&Sse41Row);
+    return "sse4.1";
+  }
+#endif
+
+#if defined(ARGUS_ROS_NEON_KERNEL)
+  if (allow_simd) {
+    row_kernel_.store(&NeonRow);
+    return "neon";
+  }
+#endif
+
+  row_kernel_.store(&ScalarRow);
+  return "scalar";
+}
+
+void argus_ros::ConvertRows(const argus_ros::FrameInputs& in,
+                            const argus_ros::FrameOutputs& out,
+                            int row_begin, int row_end) {
+  RowKernel kernel = row_kernel_.load(std::memory_order_relaxed);
+
+  // only binned planes wanted, nothing to do at full resolution
+  bool full = out.gray || out.conf || out.noise || out.xyz || out.depth ||
+              out.depth_mm || out.cloud || out.compact;
+  bool binned = (out.binned_depth || out.binned_cloud) && (out.bin > 1);
+
+  // patching after the fact would leave masked points in the compact cloud
+  const argus_ros::PixelMask* mask = in.mask;
+  bool patch = (mask != nullptr) && mask->sparse && (out.compact == nullptr);
+
+  RowArgs r;
+  r.mask_bits = nullptr;
+  r.width = in.width;
+  r.min_conf = std::max<std::uint8_t>(in.min_confidence, 1);
+  r.min_range = std::max(in.min_range, std::numeric_limits<float>::lowest());
+  r.max_range = std::min(in.max_range, std::numeric_limits<float>::max());
+  r.max_noise = in.max_noise;
+  r.mm_min = out.depth_mm_min;
+  r.mm_max = out.depth_mm_max;
+  r.cloud_step = argus_ros::CloudPointStep(out.cloud_layout);
+  r.cloud_layout = out.cloud_layout;
+
+  for (int row = row_begin; row < row_end; ++row) {
+    std::size_t off = static_cast<std::size_t>(row) * in.width;
+    r.pts = in.points + off;
+    if ((mask != nullptr) && !patch) {
+      r.mask_bits = mask->bits.data() + row * mask->words_per_row;
+    }
+
+    r.gray = out.gray ?
+        reinterpret_cast<std::uint16_t*>(out.gray + row * out.gray_step) :
+        nullptr;
+    r.conf = out.conf ? out.conf + row * out.conf_step : nullptr;
+    r.noise = out.noise ?
+        reinterpret_cast<float*>(out.noise + row * out.noise_step) : nullptr;
+    r.xyz = out.xyz ?
+        reinterpret_cast<float*>(out.xyz + row * out.xyz_step) : nullptr;
+    r.depth = out.depth ?
+        reinterpret_cast<float*>(out.depth + row * out.depth_step) : nullptr;
+    r.depth_mm = out.depth_mm ?
+        reinterpret_cast<std::uint16_t*>(out.depth_mm +
+                                         row * out.depth_mm_step) :
+        nullptr;
+    r.cloud = out.cloud ? out.cloud + off * r.cloud_step : nullptr;
+    r.compact = out.compact ? out.compact + off * r.cloud_step : nullptr;
+    r.compact_count = out.compact ? out.compact_counts + row : nullptr;
+
+    if (full) {
+      kernel(r);
+
+      if (patch) {
+        PatchMasked(r, mask->indices.data() + mask->row_offsets[row],
+                    mask->indices.data() + mask->row_offsets[row + 1], off);
+      }
+    }
+
+    if (binned && ((row + 1) % out.bin == 0) &&
+        (row < (in.height / out.bin) * out.bin)) {
+      BinRow(in, out, row / out.bin);
+    }
+  }
+}
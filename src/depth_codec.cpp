@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/depth_codec.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <lz4.h>
+
+namespace {
+//
+// RVL packs 3-bit value groups into nibbles, the high bit of a nibble
+// flagging that more groups follow. Eight nibbles make up a 32-bit word,
+// first nibble in the most significant position; words are stored most
+// significant byte first so the stream does not depend on the host byte
+// order.
+//
+// The writer expects enough room at `out`; see `EncodeRVL` for the bound.
+//
+class NibbleWriter {
+ public:
+  explicit NibbleWriter(std::uint8_t* out)
+      : out_(out), word_(0), count_(0) {}
+
+  void PutVLE(std::uint32_t value) {
+    do {
+      std::uint32_t nibble = value & 0x7;
+      value >>= 3;
+      if (value) {
+        nibble |= 0x8;
+      }
+      this->word_ = (this->word_ << 4) | nibble;
+      if (++this->count_ == 8) {
+        this->Flush();
+      }
+    } while (value);
+  }
+
+  // returns the end of the written data
+  std::uint8_t* Finish() {
+    if (this->count_) {
+      this->word_ <<= 4 * (8 - this->count_);
+      this->Flush();
+    }
+    return this->out_;
+  }
+
+ private:
+  void Flush() {
+    this->out_[0] = this->word_ >> 24;
+    this->out_[1] = this->word_ >> 16;
+    this->out_[2] = this->word_ >> 8;
+    this->out_[3] = this->word_;
+    this->out_ += 4;
+    this->word_ = 0;
+    this->count_ = 0;
+  }
+
+  std::uint8_t* out_;
+  std::uint32_t word_;
+  int count_;
+};
+
+class NibbleReader {
+ public:
+  NibbleReader(const std::uint8_t* in, std::size_t len)
+      : in_(in), end_(in + len), word_(0), count_(0) {}
+
+  bool GetVLE(std::uint32_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 3) {
+      if (this->count_ == 0) {
+        if (this->end_ - this->in_ < 4) {
+          return false;
+        }
+        this->word_ = (std::uint32_t(this->in_[0]) << 24) |
+                      (std::uint32_t(this->in_[1]) << 16) |
+                      (std::uint32_t(this->in_[2]) << 8) |
+                      std::uint32_t(this->in_[3]);
+        this->in_ += 4;
+        this->count_ = 8;
+      }
+
+      // nothing we encode needs more than 32 bits
+      if (shift > 30) {
+        return false;
+      }
+
+      std::uint32_t nibble = this->word_ >> 28;
+      this->word_ <<= 4;
+      this->count_--;
+
+      value |= (nibble & 0x7) << shift;
+      if (!(nibble & 0x8)) {
+        return true;
+      }
+    }
+  }
+
+  // whether all that is left is the zero padding of the last word
+  bool Done() const { return (this->in_ == this->end_) && !this->word_; }
+
+ private:
+  const std::uint8_t* in_;
+  const std::uint8_t* end_;
+  std::uint32_t word_;
+  int count_;
+};
+
+// zig-zag mapping of the pixel deltas, so small negative deltas stay small
+inline std::uint32_t ZigZag(int delta) {
+  return delta < 0 ? (std::uint32_t(-delta) << 1) - 1
+                   : std::uint32_t(delta) << 1;
+}
+
+// in unsigned arithmetic, as crafted input may hold any 32-bit value
+inline std::int32_t UnZigZag(std::uint32_t value) {
+  return static_cast<std::int32_t>((value >> 1) ^ (0u - (value & 1)));
+}
+
+}  // end: anonymous namespace
+
+void argus_ros::EncodeRVL(const std::uint16_t* in, std::size_t n,
+                          std::vector<std::uint8_t>& out) {
+  // Every zero/non-zero run pair spans m >= 1 pixels and its two run
+  // lengths take at most m + 2 <= 3m nibbles; every non-zero pixel adds at
+  // most 6 nibbles of delta. So 9 nibbles per pixel plus a partial word.
+  out.resize(n * 9 / 2 + 8);
+  NibbleWriter writer(out.data());
+
+  const std::uint16_t* end = in + n;
+  std::uint16_t previous = 0;
+  while (in != end) {
+    std::uint32_t zeros = 0;
+    for (; (in != end) && !*in; ++in) {
+      zeros++;
+    }
+    writer.PutVLE(zeros);
+
+    std::uint32_t nonzeros = 0;
+    for (const std::uint16_t* p = in; (p != end) && *p; ++p) {
+      nonzeros++;
+    }
+    writer.PutVLE(nonzeros);
+
+    for (std::uint32_t i = 0; i < nonzeros; ++i) {
+      std::uint16_t current = *in++;
+      writer.PutVLE(ZigZag(int(current) - int(previous)));
+      previous = current;
+    }
+  }
+  out.resize(writer.Finish() - out.data());
+}
+
+bool argus_ros::DecodeRVL(const std::uint8_t* in, std::size_t len,
+                          std::uint16_t* out, std::size_t n) {
+  NibbleReader reader(in, len);
+
+  std::size_t i = 0;
+  std::uint16_t previous = 0;
+  while (i < n) {
+    std::uint32_t zeros, nonzeros;
+    if (!reader.GetVLE(zeros) || (zeros > n - i)) {
+      return false;
+    }
+    std::fill(out + i, out + i + zeros, 0);
+    i += zeros;
+
+    if (!reader.GetVLE(nonzeros) || (nonzeros > n - i)) {
+      return false;
+    }
+    for (std::uint32_t k = 0; k < nonzeros; ++k) {
+      std::uint32_t delta;
+      if (!reader.GetVLE(delta)) {
+        return false;
+      }
+      // modulo 2^16, like the encoder's deltas
+      previous = static_cast<std::uint16_t>(
+          previous + static_cast<std::uint32_t>(UnZigZag(delta)));
+      out[i++] = previous;
+    }
+  }
+
+  // more data than pixels, e.g., a frame of another size
+  return reader.Done();
+}
+
+void argus_ros::EncodeShuffleLZ4(const std::uint8_t* in, std::size_t n,
+                                 std::size_t elem_size,
+                                 std::vector<std::uint8_t>& out,
+                                 std::vector<std::uint8_t>& scratch) {
+  std::size_t nbytes = n * elem_size;
+  const std::uint8_t* src = in;
+  if (elem_size > 1) {
+    scratch.resize(nbytes);
+    for (std::size_t k = 0; k < elem_size; ++k) {
+      std::uint8_t* plane = scratch.data() + k * n;
+      const std::uint8_t* elem = in + k;
+      for (std::size_t i = 0; i < n; ++i, elem += elem_size) {
+        plane[i] = *elem;
+      }
+    }
+    src = scratch.data();
+  }
+
+  out.resize(LZ4_compressBound(static_cast<int>(nbytes)));
+  int len = LZ4_compress_default(reinterpret_cast<const char*>(src),
+                                 reinterpret_cast<char*>(out.data()),
+                                 static_cast<int>(nbytes),
+                                 static_cast<int>(out.size()));
+  out.resize(std::max(len, 0));
+}
+
+bool argus_ros::DecodeShuffleLZ4(const std::uint8_t* in, std::size_t len,
+                                 std::uint8_t* out, std::size_t n,
+                                 std::size_t elem_size,
+                                 std::vector<std::uint8_t>& scratch) {
+  std::size_t nbytes = n * elem_size;
+  if ((elem_size == 0) ||
+      (nbytes > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) ||
+      (len > static_cast<std::size_t>(std::numeric_limits<int>::max()))) {
+    return false;
+  }
+
+  std::uint8_t* dst = out;
+  if (elem_size > 1) {
+    scratch.resize(nbytes);
+    dst = scratch.data();
+  }
+
+  int got = LZ4_decompress_safe(reinterpret_cast<const char*>(in),
+                                reinterpret_cast<char*>(dst),
+                                static_cast<int>(len),
+                                static_cast<int>(nbytes));
+  if (got != static_cast<int>(nbytes)) {
+    return false;
+  }
+
+  if (elem_size > 1) {
+    for (std::size_t k = 0; k < elem_size; ++k) {
+      const std::uint8_t* plane = scratch.data() + k * n;
+      std::uint8_t* elem = out + k;
+      for (std::size_t i = 0; i < n; ++i, elem += elem_size) {
+        *elem = plane[i];
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/lossless_transport.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <argus_ros/depth_codec.h>
+#include <boost/make_shared.hpp>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+
+namespace enc = sensor_msgs::image_encodings;
+
+namespace {
+// largest image the subscriber decodes, 256 MiB
+const std::size_t MAX_IMAGE_BYTES = std::size_t(1) << 28;
+
+// LZ4 expands its input at most about 255-fold, plus a little slack
+const std::size_t MAX_LZ4_RATIO = 256;
+
+//
+// Bytes per channel value, used as the shuffle width. Unknown encodings and
+// odd sized buffers are compressed byte-wise.
+//
+std::size_t ElementSize(const std::string& encoding, std::size_t nbytes) {
+  int depth;
+  try {
+    depth = enc::bitDepth(encoding);
+  } catch (const std::runtime_error&) {
+    return 1;
+  }
+  std::size_t elem_size = std::max(depth / 8, 1);
+  return (nbytes % elem_size) ? 1 : elem_size;
+}
+
+//
+// Whether the 16-bit values of an image of the given byte order need
+// swapping to be read as integers of this host. RVL codes the values, not
+// their bytes, so the byte order of the image does not depend on the hosts.
+//
+bool NeedsSwap(std::uint8_t is_bigendian) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  return !is_bigendian;
+#else
+  return is_bigendian != 0;
+#endif
+}
+
+void Swap16(const std::uint8_t* in, std::uint8_t* out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i, in += 2, out += 2) {
+    std::uint8_t lo = in[0];
+    out[0] = in[1];
+    out[1] = lo;
+  }
+}
+
+bool IsRVLCompatible(const std::string& encoding, std::uint32_t width,
+                     std::uint32_t step) {
+  try {
+    return (enc::bitDepth(encoding) == 16) &&
+           (enc::numChannels(encoding) == 1) &&
+           (step == width * sizeof(std::uint16_t));
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+}
+
+//
+// Size in bytes of the image described by the header fields of `message`,
+// false when they do not describe a plausible image. Incoming messages are
+// not trusted, so this is checked before any memory is set aside for them.
+//
+bool DecodedSize(const argus_ros::LosslessImage& message,
+                 std::size_t& nbytes) {
+  std::size_t pixel_size = 1;
+  try {
+    pixel_size = std::max(enc::bitDepth(message.encoding) / 8, 1) *
+                 enc::numChannels(message.encoding);
+  } catch (const std::runtime_error&) {
+  }
+
+  nbytes = static_cast<std::size_t>(message.height) * message.step;
+  if ((message.step < static_cast<std::size_t>(message.width) * pixel_size) ||
+      (nbytes > MAX_IMAGE_BYTES)) {
+    return false;
+  }
+
+  if (message.codec == argus_ros::LosslessImage::RVL) {
+    // which makes nbytes width * height * 2
+    return IsRVLCompatible(message.encoding, message.width, message.step);
+  }
+  if (message.codec == argus_ros::LosslessImage::SHUFFLE_LZ4) {
+    return nbytes <= MAX_LZ4_RATIO * message.data.size() + 64;
+  }
+  return false;
+}
+
+}  // end: anonymous namespace
+
+void argus_ros::LosslessPublisher::publish(
+    const sensor_msgs::Image& message, const PublishFn& publish_fn) const {
+  std::size_t nbytes = static_cast<std::size_t>(message.height) * message.step;
+  if (message.data.size() != nbytes) {
+    ROS_ERROR_STREAM_THROTTLE(1.0, "Not publishing malformed image: "
+                              << message.data.size() << " bytes for "
+                              << message.height << " rows of "
+                              << message.step << " bytes");
+    return;
+  }
+
+  argus_ros::LosslessImage lossless;
+  lossless.header = message.header;
+  lossless.height = message.height;
+  lossless.width = message.width;
+  lossless.encoding = message.encoding;
+  lossless.is_bigendian = message.is_bigendian;
+  lossless.step = message.step;
+
+  if (IsRVLCompatible(message.encoding, message.width, message.step)) {
+    lossless.codec = argus_ros::LosslessImage::RVL;
+    std::size_t n = nbytes / sizeof(std::uint16_t);
+    if (NeedsSwap(message.is_bigendian)) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->scratch_.resize(nbytes);
+      Swap16(message.data.data(), this->scratch_.data(), n);
+      argus_ros::EncodeRVL(
+          reinterpret_cast<const std::uint16_t*>(this->scratch_.data()), n,
+          lossless.data);
+    } else {
+      argus_ros::EncodeRVL(
+          reinterpret_cast<const std::uint16_t*>(message.data.data()), n,
+          lossless.data);
+    }
+  } else {
+    lossless.codec = argus_ros::LosslessImage::SHUFFLE_LZ4;
+    std::size_t elem_size = ElementSize(message.encoding, nbytes);
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    argus_ros::EncodeShuffleLZ4(message.data.data(), nbytes / elem_size,
+                                elem_size, lossless.data, this->scratch_);
+  }
+
+  publish_fn(lossless);
+}
+
+void argus_ros::LosslessSubscriber::internalCallback(
+    const argus_ros::LosslessImage::ConstPtr& message,
+    const Callback& user_cb) {
+  sensor_msgs::ImagePtr image = boost::make_shared<sensor_msgs::Image>();
+  image->header = message->header;
+  image->height = message->height;
+  image->width = message->width;
+  image->encoding = message->encoding;
+  image->is_bigendian = message->is_bigendian;
+  image->step = message->step;
+
+  std::size_t nbytes;
+  if (!DecodedSize(*message, nbytes)) {
+    ROS_ERROR_STREAM_THROTTLE(1.0, "Not decoding malformed lossless "
+                              << message->encoding << " image: "
+                              << message->width << "x" << message->height
+                              << ", step " << message->step << ", codec "
+                              << static_cast<int>(message->codec) << ", "
+                              << message->data.size() << " bytes");
+    return;
+  }
+  image->data.resize(nbytes);
+
+  bool ok = false;
+  if (message->codec == argus_ros::LosslessImage::RVL) {
+    ok = argus_ros::DecodeRVL(
+        message->data.data(), message->data.size(),
+        reinterpret_cast<std::uint16_t*>(image->data.data()),
+        nbytes / sizeof(std::uint16_t));
+    if (ok && NeedsSwap(message->is_bigendian)) {
+      Swap16(image->data.data(), image->data.data(),
+             nbytes / sizeof(std::uint16_t));
+    }
+  } else if (message->codec == argus_ros::LosslessImage::SHUFFLE_LZ4) {
+    std::size_t elem_size = ElementSize(message->encoding, nbytes);
+    ok = argus_ros::DecodeShuffleLZ4(
+        message->data.data(), message->data.size(), image->data.data(),
+        nbytes / elem_size, elem_size, this->scratch_);
+  }
+
+  if (!ok) {
+    ROS_ERROR_STREAM_THROTTLE(1.0, "Could not decode lossless "
+                              << message->encoding << " image (codec "
+                              << static_cast<int>(message->codec) << ")");
+    return;
+  }
+
+  user_cb(image);
+}
+
+PLUGINLIB_EXPORT_CLASS(argus_ros::LosslessPublisher,
+                       image_transport::PublisherPlugin)
+PLUGINLIB_EXPORT_CLASS(argus_ros::LosslessSubscriber,
+                       image_transport::SubscriberPlugin)
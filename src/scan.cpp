@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/scan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+
+argus_ros::ScanTable argus_ros::BuildScanTable(
+    const argus::DepthPoint* uvec, int stride, int x_offset, int y_offset,
+    int width, int height, const argus_ros::ScanParams& params) {
+  argus_ros::ScanTable table;
+  table.width = width;
+  table.height = height;
+  table.bins.assign(static_cast<std::size_t>(width) * height, -1);
+  table.angle_increment = params.angle_increment;
+
+  // angle of each pixel in the sensor frame (x = optical z, y = -optical x)
+  std::vector<float> angles(table.bins.size());
+  float lo = std::numeric_limits<float>::infinity();
+  float hi = -lo;
+  for (int r = 0; r < height; ++r) {
+    const argus::DepthPoint* u = uvec + (y_offset + r) * stride + x_offset;
+    for (int c = 0; c < width; ++c) {
+      float& a = angles[r * width + c];
+      a = (u[c].z > 0.f) ? std::atan2(-u[c].x, u[c].z) :
+                           std::numeric_limits<float>::quiet_NaN();
+      if (!std::isnan(a)) {
+        lo = std::min(lo, a);
+        hi = std::max(hi, a);
+      }
+    }
+  }
+  if (!(lo <= hi) || !(params.angle_increment > 0.f)) {
+    return table;
+  }
+
+  table.angle_min = lo;
+  table.nbins =
+      static_cast<int>(std::lround((hi - lo) / params.angle_increment)) + 1;
+  for (std::size_t i = 0; i < angles.size(); ++i) {
+    if (!std::isnan(angles[i])) {
+      int bin = static_cast<int>(
+          std::lround((angles[i] - lo) / params.angle_increment));
+      table.bins[i] = std::min(bin, table.nbins - 1);
+    }
+  }
+  return table;
+}
+
+void argus_ros::ProjectScan(const argus_ros::FrameInputs& in,
+                            const argus_ros::ScanTable& table,
+                            const argus_ros::ScanParams& params,
+                            float* ranges) {
+  argus_ros::ScanRows(in, table, params, 0, in.height, ranges);
+  argus_ros::MergeScan(ranges, 1, table.nbins, ranges);
+}
+
+void argus_ros::ScanRows(const argus_ros::FrameInputs& in,
+                         const argus_ros::ScanTable& table,
+                         const argus_ros::ScanParams& params, int row_begin,
+                         int row_end, float* sq) {
+  std::fill(sq, sq + table.nbins, std::numeric_limits<float>::infinity());
+
+  // compare squared ranges, one sqrt per bin instead of per point
+  const float min_sq = params.range_min * params.range_min;
+  const float max_sq = params.range_max * params.range_max;
+
+  for (int r = row_begin; r < row_end; ++r) {
+    const argus::DepthPoint* pts = in.points + r * in.width;
+    const std::int32_t* bins = table.bins.data() + r * table.width;
+    for (int c = 0; c < in.width; ++c) {
+      const argus::DepthPoint& p = pts[c];
+      // sensor frame height is -y of the optical frame
+      float z = -p.y;
+      if ((bins[c] < 0) || !(z >= params.min_height) ||
+          !(z <= params.max_height) || !argus_ros::IsValidPixel(in, r, c)) {
+        continue;
+      }
+      float d = p.z * p.z + p.x * p.x;
+      if ((d >= min_sq) && (d <= max_sq) && (d < sq[bins[c]])) {
+        sq[bins[c]] = d;
+      }
+    }
+  }
+}
+
+void argus_ros::MergeScan(const float* sq, int nbands, int nbins,
+                          float* ranges) {
+  const float inf = std::numeric_limits<float>::infinity();
+  for (int i = 0; i < nbins; ++i) {
+    float d = sq[i];
+    for (int b = 1; b < nbands; ++b) {
+      d = std::min(d, sq[b * nbins + i]);
+    }
+    ranges[i] = (d != inf) ? std::sqrt(d) : inf;
+  }
+}
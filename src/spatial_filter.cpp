@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/spatial_filter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include <argus.hpp>
+#include <argus_ros/vec4.h>
+
+using namespace argus_ros::vec4;
+
+namespace {
+// keeps the weight of noise-free pixels finite
+const float NOISE_FLOOR_SQ = 1e-6f;
+
+//
+// One recursive pass down and back up four neighbouring columns, one per
+// lane: `coef[k * stride]` holds the feedback between row k - 1 and k.
+//
+void RecurseColumns(int n, std::size_t stride, float* num, float* den,
+                    const float* coef) {
+  // top to bottom
+  V4f pn = Load<V4f>(num);
+  V4f pd = Load<V4f>(den);
+  for (int k = 1; k < n; ++k) {
+    std::size_t off = k * stride;
+    V4f a = Load<V4f>(coef + off);
+    V4f vn = Load<V4f>(num + off);
+    V4f vd = Load<V4f>(den + off);
+    pn = vn + a * (pn - vn);
+    pd = vd + a * (pd - vd);
+    Store(num + off, pn);
+    Store(den + off, pd);
+  }
+
+  // and back
+  for (int k = n - 2; k >= 0; --k) {
+    std::size_t off = k * stride;
+    V4f a = Load<V4f>(coef + off + stride);
+    V4f vn = Load<V4f>(num + off);
+    V4f vd = Load<V4f>(den + off);
+    pn = vn + a * (pn - vn);
+    pd = vd + a * (pd - vd);
+    Store(num + off, pn);
+    Store(den + off, pd);
+  }
+}
+
+//
+// Loads the 4x4 tile at column `k` of four rows `stride` floats apart,
+// transposed: `t[j]` holds column k + j of the four rows
+//
+inline void LoadTile(const float* plane, std::size_t stride, std::size_t k,
+                     V4f* t) {
+  t[0] = Load<V4f>(plane + k);
+  t[1] = Load<V4f>(plane + stride + k);
+  t[2] = Load<V4f>(plane + 2 * stride + k);
+  t[3] = Load<V4f>(plane + 3 * stride + k);
+  Transpose(t[0], t[1], t[2], t[3]);
+}
+
+inline void StoreTile(float* plane, std::size_t stride, std::size_t k,
+                      V4f* t) {
+  Transpose(t[0], t[1], t[2], t[3]);
+  Store(plane + k, t[0]);
+  Store(plane + stride + k, t[1]);
+  Store(plane + 2 * stride + k, t[2]);
+  Store(plane + 3 * stride + k, t[3]);
+}
+
+//
+// One recursive pass left to right and back along four rows, one per lane,
+// which are transposed 4x4 tile by tile so the recursion runs on whole
+// vectors. It covers the padding, whose zero feedback leaves the state
+// unchanged across the row ends: `coef[k]` holds the feedback between
+// column k - 1 and k, and is zero at column 0 and beyond the row.
+//
+void RecurseRows(std::size_t stride, float* num, float* den,
+                 const float* coef) {
+  V4f tn[4], td[4], ta[4];
+
+  // left to right
+  V4f pn = Splat(0.f);
+  V4f pd = Splat(0.f);
+  for (std::size_t k = 0; k < stride; k += 4) {
+    LoadTile(num, stride, k, tn);
+    LoadTile(den, stride, k, td);
+    LoadTile(coef, stride, k, ta);
+    for (int j = 0; j < 4; ++j) {
+      pn = tn[j] + ta[j] * (pn - tn[j]);
+      pd = td[j] + ta[j] * (pd - td[j]);
+      tn[j] = pn;
+      td[j] = pd;
+    }
+    StoreTile(num, stride, k, tn);
+    StoreTile(den, stride, k, td);
+  }
+
+  // and back, with the feedback of the column to the right
+  V4f a = Splat(0.f);
+  for (std::size_t k = stride; k > 0;) {
+    k -= 4;
+    LoadTile(num, stride, k, tn);
+    LoadTile(den, stride, k, td);
+    LoadTile(coef, stride, k, ta);
+    for (int j = 3; j >= 0; --j) {
+      pn = tn[j] + a * (pn - tn[j]);
+      pd = td[j] + a * (pd - td[j]);
+      tn[j] = pn;
+      td[j] = pd;
+      a = ta[j];
+    }
+    StoreTile(num, stride, k, tn);
+    StoreTile(den, stride, k, td);
+  }
+}
+
+}  // end: anonymous namespace
+
+void argus_ros::SpatialFilter::Apply(const argus_ros::SpatialParams& params,
+                                     argus::DepthPoint* points, int width,
+                                     int height) {
+  if (params.iterations <= 0) {
+    if (!this->storage_.empty()) {
+      *this = argus_ros::SpatialFilter();
+    }
+    return;
+  }
+
+  if ((width != this->width_) || (height != this->height_)) {
+    this->width_ = width;
+    this->height_ = height;
+    this->stride_ = (static_cast<std::size_t>(width) + 3) &
+                    ~static_cast<std::size_t>(3);
+    this->rows_ = (static_cast<std::size_t>(height) + 3) &
+                  ~static_cast<std::size_t>(3);
+    this->size_ = this->stride_ * this->rows_;
+    this->storage_.assign(NPLANES * this->size_, 0.f);
+  }
+
+  const std::size_t stride = this->stride_;
+  float* depth = this->Plane(DEPTH);
+  float* num = this->Plane(NUM);
+  float* den = this->Plane(DEN);
+  float* coef_h = this->Plane(COEF_H);
+  float* coef_v = this->Plane(COEF_V);
+
+  //
+  // Weights and the edge-aware feedback of the first iteration. Later
+  // iterations halve the spatial extent, which squares the feedback.
+  //
+  int iterations = std::min(params.iterations,
+                            argus_ros::MAX_SPATIAL_ITERATIONS);
+  float sigma_h = params.sigma_s * std::sqrt(3.f) *
+                  std::ldexp(1.f, iterations - 1) /
+                  std::sqrt(std::ldexp(1.f, 2 * iterations) - 1.f);
+  float log_a = -std::sqrt(2.f) / std::max(sigma_h, 1e-3f);
+  float edge = params.sigma_s / std::max(params.sigma_r, 1e-6f);
+
+  for (int r = 0; r < height; ++r) {
+    const argus::DepthPoint* pts = points + r * width;
+    float* d = depth + r * stride;
+    for (int c = 0; c < width; ++c) {
+      // invalid pixels may hold NaN or infinite values, which must not
+      // reach the recursion
+      const argus::DepthPoint& p = pts[c];
+      bool valid = (p.depthConfidence > 0) && (p.z > 0.f) &&
+                   std::isfinite(p.z) && std::isfinite(p.noise);
+      float w = 0.f;
+      if (valid) {
+        w = p.depthConfidence / (p.noise * p.noise + NOISE_FLOOR_SQ);
+      }
+      d[c] = valid ? p.z : 0.f;
+      num[r * stride + c] = valid ? w * d[c] : 0.f;
+      den[r * stride + c] = w;
+    }
+
+    // left neighbour; invalid pixels cut the smoothing
+    float* ch = coef_h + r * stride;
+    for (int c = 1; c < width; ++c) {
+      ch[c] = (d[c] > 0.f) && (d[c - 1] > 0.f) ?
+          std::exp(log_a * (1.f + edge * std::fabs(d[c] - d[c - 1]))) : 0.f;
+    }
+
+    // upper neighbour
+    if (r > 0) {
+      const float* up = d - stride;
+      float* cv = coef_v + r * stride;
+      for (int c = 0; c < width; ++c) {
+        cv[c] = (d[c] > 0.f) && (up[c] > 0.f) ?
+            std::exp(log_a * (1.f + edge * std::fabs(d[c] - up[c]))) : 0.f;
+      }
+    }
+  }
+
+  for (int it = 0; it < iterations; ++it) {
+    // rows, four at a time
+    for (std::size_t r = 0; r < this->rows_; r += 4) {
+      std::size_t off = r * stride;
+      RecurseRows(stride, num + off, den + off, coef_h + off);
+    }
+
+    // columns, four at a time
+    for (std::size_t c = 0; c < stride; c += 4) {
+      RecurseColumns(height, stride, num + c, den + c, coef_v + c);
+    }
+
+    if (it + 1 < iterations) {
+      for (std::size_t i = 0; i < this->size_; i += 4) {
+        V4f h = Load<V4f>(coef_h + i);
+        V4f v = Load<V4f>(coef_v + i);
+        Store(coef_h + i, h * h);
+        Store(coef_v + i, v * v);
+      }
+    }
+  }
+
+  //
+  // Back onto the points, moving x and y along the pixel's ray
+  //
+  for (int r = 0; r < height; ++r) {
+    argus::DepthPoint* pts = points + r * width;
+    const float* d = depth + r * stride;
+    const float* n = num + r * stride;
+    const float* w = den + r * stride;
+    for (int c = 0; c < width; ++c) {
+      if (d[c] > 0.f) {
+        float z = n[c] / w[c];
+        float scale = z / d[c];
+        pts[c].x *= scale;
+        pts[c].y *= scale;
+        pts[c].z = z;
+      }
+    }
+  }
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/temporal_filter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include <argus.hpp>
+#include <argus_ros/vec4.h>
+
+namespace {
+using namespace argus_ros::vec4;
+
+// the frame counter is rebased before it can overflow
+const std::int32_t MAX_FRAME = 1 << 30;
+
+}  // end: anonymous namespace
+
+void argus_ros::TemporalFilter::Reset() {
+  this->epoch_ = this->frame_ + 1;
+  if (!this->storage_.empty()) {
+    float* estimate = this->Plane(2 * this->slots_);
+    std::fill(estimate, estimate + this->stride_, 0.f);
+  }
+}
+
+void argus_ros::TemporalFilter::Apply(
+    const argus_ros::TemporalParams& params, const argus_ros::FrameInputs& in,
+    argus::DepthPoint* points) {
+  if (params.mode == argus_ros::TemporalMode::NONE) {
+    if (!this->storage_.empty()) {
+      *this = argus_ros::TemporalFilter();
+    }
+    return;
+  }
+
+  const int width = in.width;
+  const int height = in.height;
+  int slots = (params.mode == argus_ros::TemporalMode::EMA) ?
+      1 : std::min(std::max(params.history, 1), argus_ros::MAX_HISTORY);
+  if ((width != this->width_) || (height != this->height_) ||
+      (slots != this->slots_) || (params.mode != this->params_.mode) ||
+      (this->frame_ >= MAX_FRAME)) {
+    // starts over from all-zero planes, whose padding stays zero for good
+    this->width_ = width;
+    this->height_ = height;
+    this->slots_ = slots;
+    this->stride_ = (static_cast<std::size_t>(width) * height + 15) &
+                    ~static_cast<std::size_t>(15);
+    this->storage_.assign((2 * slots + 2) * this->stride_ + 16, 0.f);
+    this->offset_ = (64 - reinterpret_cast<std::uintptr_t>(
+                              this->storage_.data()) % 64) % 64 /
+                    sizeof(float);
+    std::fill(this->slot_frame_, this->slot_frame_ + argus_ros::MAX_HISTORY,
+              0);
+    this->frame_ = 0;
+    this->epoch_ = 1;
+  }
+  this->params_ = params;
+
+  const int n = width * height;
+  const int slot = ++this->frame_ % slots;
+  this->slot_frame_[slot] = this->frame_;
+
+  float* estimate = this->Plane(2 * slots);
+  float* since = this->Plane(2 * slots + 1);
+
+  //
+  // Split the newest frame into the ring and see how much of it moved
+  //
+  float* depth = this->Plane(slot);
+  float* weight = this->Plane(slots + slot);
+  int tracked = 0;
+  int jumped = 0;
+  for (int r = 0, i = 0; r < height; ++r) {
+    for (int c = 0; c < width; ++c, ++i) {
+      // a depth of 0 marks the invalid pixels in the planes
+      const argus::DepthPoint& p = points[i];
+      bool valid = argus_ros::IsValidPixel(in, r, c) && (p.z > 0.f);
+      depth[i] = valid ? p.z : 0.f;
+      weight[i] = valid ? p.depthConfidence : 0.f;
+      if (valid && (estimate[i] > 0.f)) {
+        tracked++;
+        jumped += std::fabs(p.z - estimate[i]) > params.max_jump;
+      }
+    }
+  }
+  if ((tracked > 0) && (jumped > params.motion_fraction * tracked)) {
+    // the scene moved, start over from this frame
+    this->epoch_ = this->frame_;
+    std::fill(estimate, estimate + this->stride_, 0.f);
+  }
+
+  //
+  // Filter the planes four pixels at a time
+  //
+  const V4f zero = Splat(0.f);
+  const V4f inf = Splat(std::numeric_limits<float>::infinity());
+  const V4f alpha = Splat(params.alpha);
+  const V4f max_jump = Splat(params.max_jump);
+  const V4i frame = Splat(this->frame_);
+  const V4i epoch = Splat(this->epoch_);
+
+  // the ring slots from oldest to newest; stale ones fail the `start` test
+  const float* ring_depth[argus_ros::MAX_HISTORY];
+  const float* ring_weight[argus_ros::MAX_HISTORY];
+  V4i ring_frame[argus_ros::MAX_HISTORY];
+  for (int k = 0; k < slots; ++k) {
+    int s = (slot + 1 + k) % slots;
+    ring_depth[k] = this->Plane(s);
+    ring_weight[k] = this->Plane(slots + s);
+    ring_frame[k] = Splat(this->slot_frame_[s]);
+  }
+
+  for (int i = 0; i < n; i += 4) {
+    V4f z = Load<V4f>(depth + i);
+    V4f est = Load<V4f>(estimate + i);
+    V4i first = Load<V4i>(since + i);
+
+    V4i valid = z > zero;
+    V4i tracked = valid & (est > zero);
+    V4i jump = tracked & ((z - est > max_jump) | (est - z > max_jump));
+    first = jump ? frame : first;
+    V4i start = Max(first, epoch);
+
+    V4f out;
+    if (params.mode == argus_ros::TemporalMode::EMA) {
+      out = (tracked & ~jump) ? est + alpha * (z - est) : z;
+    } else if (params.mode == argus_ros::TemporalMode::WEIGHTED) {
+      V4f sum_wz = zero;
+      V4f sum_w = zero;
+      for (int k = 0; k < slots; ++k) {
+        V4f w = Load<V4f>(ring_weight[k] + i);
+        w = (ring_frame[k] >= start) ? w : zero;
+        sum_wz += w * Load<V4f>(ring_depth[k] + i);
+        sum_w += w;
+      }
+      // the newest depth is in the sum, so valid pixels have sum_w > 0
+      out = valid ? sum_wz / (sum_w > zero ? sum_w : inf) : z;
+    } else {
+      V4f vals[argus_ros::MAX_HISTORY];
+      V4i count = Splat(0);
+      for (int k = 0; k < slots; ++k) {
+        V4f d = Load<V4f>(ring_depth[k] + i);
+        V4i ok = (ring_frame[k] >= start) & (d > zero);
+        vals[k] = ok ? d : inf;
+        count -= ok;
+      }
+
+      // odd-even transposition sort, the invalid (inf) values end up last
+      for (int round = 0; round < slots; ++round) {
+        for (int k = round & 1; k + 1 < slots; k += 2) {
+          V4f lo = Min(vals[k], vals[k + 1]);
+          vals[k + 1] = Max(vals[k], vals[k + 1]);
+          vals[k] = lo;
+        }
+      }
+
+      V4i mid = (count - 1) >> 1;
+      out = z;
+      for (int k = 0; k < slots; ++k) {
+        out = (valid & (mid == Splat(k))) ? vals[k] : out;
+      }
+    }
+
+    Store(estimate + i, valid ? out : est);
+    Store(since + i, first);
+
+    // back onto the points, moving x and y along the pixel's ray
+    float o[4], d[4];
+    Store(o, out);
+    Store(d, z);
+    for (int l = 0; (l < 4) && (i + l < n); ++l) {
+      if ((d[l] > 0.f) && (o[l] != d[l])) {
+        argus::DepthPoint& p = points[i + l];
+        float scale = o[l] / d[l];
+        p.x *= scale;
+        p.y *= scale;
+        p.z = o[l];
+      }
+    }
+  }
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Time per frame of the voxel grid behind stream/X/cloud_voxel on a
+// synthetic ToF frame (a tilted wall with a box in front of it, sensor noise
+// and invalid pixels), next to a sort-based centroid reduction as done by
+// PCL's VoxelGrid as the baseline.
+//
+// usage: argus_ros_voxel_bench [width height [iterations]]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <argus_ros/voxel_grid.h>
+
+namespace {
+
+std::vector<argus::DepthPoint> MakeScene(int width, int height) {
+  std::vector<argus::DepthPoint> points(width * height);
+
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.f, 0.004f);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+  for (int r = 0; r < height; ++r) {
+    for (int c = 0; c < width; ++c) {
+      float u = (c - width / 2.f) / width;
+      float v = (r - height / 2.f) / height;
+      float z = 2.f + 0.8f * u;
+      if ((std::fabs(u) < 0.15f) && (std::fabs(v) < 0.2f)) {
+        z = 1.2f;
+      }
+      z += noise(rng);
+
+      // dark corners and a few flying pixels
+      bool valid = (u * u + v * v < 0.28f) && (uniform(rng) > 0.03f);
+
+      argus::DepthPoint& p = points[r * width + c];
+      p = argus::DepthPoint();
+      p.x = u * z;
+      p.y = v * z;
+      p.z = z;
+      p.noise = 0.004f;
+      p.grayValue = static_cast<std::uint16_t>(1000.f * uniform(rng));
+      p.depthConfidence = valid ? 255 : 0;
+    }
+  }
+  return points;
+}
+
+//
+// Centroid per voxel by sorting (voxel key, pixel) pairs and reducing the
+// runs of equal keys. `pairs` is kept between calls, like the voxel grid's
+// tables.
+//
+std::size_t SortReduce(const argus_ros::FrameInputs& in, float leaf_size,
+                       std::vector<std::pair<std::uint64_t, std::uint32_t> >&
+                           pairs,
+                       std::uint8_t* out) {
+  const float inv_leaf = 1.f / leaf_size;
+  const float bias = static_cast<float>(1 << 20);
+
+  pairs.clear();
+  for (int r = 0; r < in.height; ++r) {
+    for (int c = 0; c < in.width; ++c) {
+      if (!argus_ros::IsValidPixel(in, r, c)) {
+        continue;
+      }
+      const argus::DepthPoint& p = in.points[r * in.width + c];
+      std::uint64_t kx = static_cast<std::uint64_t>(
+          std::floor(p.z * inv_leaf) + bias);
+      std::uint64_t ky = static_cast<std::uint64_t>(
+          std::floor(-p.x * inv_leaf) + bias);
+      std::uint64_t kz = static_cast<std::uint64_t>(
+          std::floor(-p.y * inv_leaf) + bias);
+      pairs.emplace_back((kx << 42) | (ky << 21) | kz,
+                         static_cast<std::uint32_t>(r * in.width + c));
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+
+  std::size_t nvox = 0;
+  for (std::size_t i = 0; i < pairs.size();) {
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    std::size_t j = i;
+    for (; (j < pairs.size()) && (pairs[j].first == pairs[i].first); ++j) {
+      const argus::DepthPoint& p = in.points[pairs[j].second];
+      sum[0] += p.z;
+      sum[1] -= p.x;
+      sum[2] -= p.y;
+      sum[3] += p.grayValue;
+    }
+    float* pt = reinterpret_cast<float*>(out) + 4 * nvox++;
+    for (int k = 0; k < 4; ++k) {
+      pt[k] = sum[k] / (j - i);
+    }
+    i = j;
+  }
+  return nvox;
+}
+
+void Report(const std::string& name, int iterations,
+            const std::function<std::size_t()>& reduce) {
+  std::size_t nvox = reduce();
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    reduce();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() /
+              iterations;
+  std::cout << std::left << std::setw(26) << name << std::right
+            << std::setw(10) << nvox << std::fixed << std::setprecision(3)
+            << std::setw(12) << ms << std::endl;
+}
+
+}  // end: anonymous namespace
+
+int main(int argc, const char** argv) {
+  int width = (argc > 2) ? std::atoi(argv[1]) : 224;
+  int height = (argc > 2) ? std::atoi(argv[2]) : 172;
+  int iterations = (argc > 3) ? std::atoi(argv[3]) : 200;
+  if ((width <= 0) || (height <= 0) || (iterations <= 0)) {
+    std::cerr << "usage: " << argv[0] << " [width height [iterations]]"
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<argus::DepthPoint> points = MakeScene(width, height);
+  argus_ros::FrameInputs in;
+  in.points = points.data();
+  in.width = width;
+  in.height = height;
+
+  std::vector<std::uint8_t> out(points.size() * 4 * sizeof(float));
+  std::vector<std::pair<std::uint64_t, std::uint32_t> > pairs;
+  pairs.reserve(points.size());
+  argus_ros::VoxelGrid grid;
+
+  std::cout << width << "x" << height << ", " << iterations
+            << " iterations" << std::endl;
+  std::cout << std::left << std::setw(26) << "reduction" << std::right
+            << std::setw(10) << "voxels" << std::setw(12) << "ms/frame"
+            << std::endl;
+
+  static const char* names[] = {"centroid", "nearest", "max intensity"};
+  for (float leaf_size : {0.01f, 0.05f, 0.2f}) {
+    std::string leaf = std::to_string(std::lround(leaf_size * 100.f)) +
+                       "cm ";
+    for (int i = 0; i < 3; ++i) {
+      argus_ros::VoxelParams params;
+      params.leaf_size = leaf_size;
+      params.reduction = static_cast<argus_ros::VoxelReduction>(i);
+      Report(leaf + names[i], iterations,
+             [&] { return grid.Reduce(in, params, out.data()); });
+    }
+    Report(leaf + "centroid (sort)", iterations,
+           [&] { return SortReduce(in, leaf_size, pairs, out.data()); });
+  }
+
+  return 0;
+}
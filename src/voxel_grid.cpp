@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/voxel_grid.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+
+using argus_ros::VoxelReduction;
+
+namespace {
+// 21 bits per voxel coordinate, biased to be non-negative
+const int KEY_BITS = 21;
+const float KEY_BIAS = static_cast<float>(1 << (KEY_BITS - 1));
+const std::uint64_t KEY_MASK = (std::uint64_t(1) << KEY_BITS) - 1;
+
+// never a packed key, those use the low 63 bits only
+const std::uint64_t EMPTY = ~std::uint64_t(0);
+
+// Fibonacci hashing onto `bits` bits
+inline std::size_t Hash(std::uint64_t key, int bits) {
+  return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >>
+                                  (64 - bits));
+}
+
+}  // end: anonymous namespace
+
+std::size_t argus_ros::VoxelGrid::Reduce(const argus_ros::FrameInputs& in,
+                                         const argus_ros::VoxelParams& params,
+                                         std::uint8_t* out) {
+  const std::size_t npix = static_cast<std::size_t>(in.width) * in.height;
+  if ((npix == 0) || !(params.leaf_size > 0.f)) {
+    return 0;
+  }
+
+  // at most half full, so probe sequences stay short
+  int bits = 1;
+  while ((std::size_t(1) << bits) < 2 * npix) {
+    ++bits;
+  }
+  const std::size_t nslots = std::size_t(1) << bits;
+  if (this->keys_.size() != nslots) {
+    this->keys_.assign(nslots, EMPTY);
+    this->index_.resize(nslots);
+  }
+  if (this->voxels_.size() < npix) {
+    this->voxels_.resize(npix);
+  }
+
+  const float inv_leaf = 1.f / params.leaf_size;
+  const float half_leaf = 0.5f * params.leaf_size;
+  const VoxelReduction reduction = params.reduction;
+  std::uint64_t* keys = this->keys_.data();
+  std::uint32_t* index = this->index_.data();
+  Voxel* voxels = this->voxels_.data();
+  std::uint32_t nvox = 0;
+
+  for (int r = 0; r < in.height; ++r) {
+    const argus::DepthPoint* pts = in.points + r * in.width;
+    for (int c = 0; c < in.width; ++c) {
+      if (!argus_ros::IsValidPixel(in, r, c)) {
+        continue;
+      }
+
+      // sensor frame, like the cloud
+      const argus::DepthPoint& p = pts[c];
+      const float x = p.z;
+      const float y = -p.x;
+      const float z = -p.y;
+      const float intensity = p.grayValue;
+
+      const float fx = std::floor(x * inv_leaf);
+      const float fy = std::floor(y * inv_leaf);
+      const float fz = std::floor(z * inv_leaf);
+      if (!(std::fabs(fx) < KEY_BIAS) || !(std::fabs(fy) < KEY_BIAS) ||
+          !(std::fabs(fz) < KEY_BIAS)) {
+        continue;
+      }
+      const std::uint64_t key =
+          ((static_cast<std::uint64_t>(fx + KEY_BIAS) & KEY_MASK) <<
+           (2 * KEY_BITS)) |
+          ((static_cast<std::uint64_t>(fy + KEY_BIAS) & KEY_MASK) <<
+           KEY_BITS) |
+          (static_cast<std::uint64_t>(fz + KEY_BIAS) & KEY_MASK);
+
+      std::size_t slot = Hash(key, bits);
+      while ((keys[slot] != EMPTY) && (keys[slot] != key)) {
+        slot = (slot + 1) & (nslots - 1);
+      }
+
+      // how well the point represents its voxel; lower is better
+      float score = 0.f;
+      if (reduction == VoxelReduction::NEAREST) {
+        const float dx = x - (fx * params.leaf_size + half_leaf);
+        const float dy = y - (fy * params.leaf_size + half_leaf);
+        const float dz = z - (fz * params.leaf_size + half_leaf);
+        score = dx * dx + dy * dy + dz * dz;
+      } else if (reduction == VoxelReduction::MAX_INTENSITY) {
+        score = -intensity;
+      }
+
+      if (keys[slot] == EMPTY) {
+        keys[slot] = key;
+        index[slot] = nvox;
+        Voxel& v = voxels[nvox++];
+        v.x = x;
+        v.y = y;
+        v.z = z;
+        v.intensity = intensity;
+        v.score = (reduction == VoxelReduction::CENTROID) ? 1.f : score;
+        v.slot = static_cast<std::uint32_t>(slot);
+        continue;
+      }
+
+      Voxel& v = voxels[index[slot]];
+      if (reduction == VoxelReduction::CENTROID) {
+        v.x += x;
+        v.y += y;
+        v.z += z;
+        v.intensity += intensity;
+        v.score += 1.f;
+      } else if (score < v.score) {
+        v.x = x;
+        v.y = y;
+        v.z = z;
+        v.intensity = intensity;
+        v.score = score;
+      }
+    }
+  }
+
+  //
+  // Write out the voxels and hand back the slots they used
+  //
+  for (std::uint32_t i = 0; i < nvox; ++i) {
+    Voxel& v = voxels[i];
+    keys[v.slot] = EMPTY;
+    if (reduction == VoxelReduction::CENTROID) {
+      const float inv_n = 1.f / v.score;
+      v.x *= inv_n;
+      v.y *= inv_n;
+      v.z *= inv_n;
+      v.intensity *= inv_n;
+    }
+    const float pt[4] = {v.x, v.y, v.z, v.intensity};
+    std::memcpy(out + i * sizeof(pt), pt, sizeof(pt));
+  }
+  return nvox;
+}
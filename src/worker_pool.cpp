@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <argus_ros/worker_pool.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <ros/ros.h>
+
+argus_ros::WorkerPool::WorkerPool(std::size_t nworkers,
+                                  const std::vector<int>& cpus)
+    : job_(nullptr),
+      nrows_(0),
+      nbands_(0),
+      next_band_(0),
+      busy_(0),
+      generation_(0),
+      stop_(false) {
+  for (std::size_t i = 0; i < nworkers; ++i) {
+    this->threads_.emplace_back(&WorkerPool::Run, this);
+
+    if (cpus.empty()) {
+      continue;
+    }
+
+#if defined(__linux__)
+    int cpu = cpus[i % cpus.size()];
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (pthread_setaffinity_np(this->threads_.back().native_handle(),
+                               sizeof(cpu_set_t), &cpuset) != 0) {
+      ROS_WARN_STREAM("Could not pin conversion worker " << i
+                      << " to cpu " << cpu);
+    }
+#else
+    ROS_WARN_STREAM("CPU affinity is not supported on this platform");
+#endif
+  }
+}
+
+argus_ros::WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stop_ = true;
+  }
+  this->work_cv_.notify_all();
+  for (auto& t : this->threads_) {
+    t.join();
+  }
+}
+
+void argus_ros::WorkerPool::ForEachBand(
+    int nrows, const std::function<void(int, int)>& fn) {
+  std::unique_lock<std::mutex> call_lock(this->call_mutex_, std::try_to_lock);
+  if (this->threads_.empty() || (nrows < 2) || !call_lock.owns_lock()) {
+    fn(0, nrows);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->job_ = &fn;
+    this->nrows_ = nrows;
+    this->nbands_ = std::min<int>(nrows, this->threads_.size() + 1);
+    this->next_band_.store(0);
+    this->busy_ = this->threads_.size();
+    this->generation_++;
+  }
+  this->work_cv_.notify_all();
+
+  this->RunBands();
+
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->done_cv_.wait(lock, [this] { return this->busy_ == 0; });
+  this->job_ = nullptr;
+}
+
+void argus_ros::WorkerPool::RunBands() {
+  for (int band = this->next_band_.fetch_add(1); band < this->nbands_;
+       band = this->next_band_.fetch_add(1)) {
+    int row_begin = static_cast<long>(band) * this->nrows_ / this->nbands_;
+    int row_end = static_cast<long>(band + 1) * this->nrows_ / this->nbands_;
+    (*this->job_)(row_begin, row_end);
+  }
+}
+
+void argus_ros::WorkerPool::Run() {
+  std::uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->work_cv_.wait(
+          lock, [this, seen] { return this->stop_ || this->generation_ != seen; });
+      if (this->stop_) {
+        return;
+      }
+      seen = this->generation_;
+    }
+
+    this->RunBands();
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->busy_--;
+    }
+    this->done_cv_.notify_one();
+  }
+}
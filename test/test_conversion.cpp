@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// The conversion kernels must reproduce the values the node published
+// before they existed, and the SIMD kernels must produce exactly the same
+// bytes as the scalar one, for every plane and every combination of inputs.
+//
+
+#include <argus_ros/conversion.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <argus.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+const float NaN_ = std::numeric_limits<float>::quiet_NaN();
+const float Inf_ = std::numeric_limits<float>::infinity();
+
+// filler of the output planes, so unwritten bytes show up as mismatches
+const std::uint8_t FILL = 0xAB;
+
+//
+// A random frame with a share of the awkward pixels: zero confidence, NaN or
+// infinite coordinates, and depths and noise right on the gates
+//
+struct Frame {
+  int width;
+  int height;
+  std::vector<argus::DepthPoint> points;
+  std::vector<float> mask;  // transposed, see argus_ros::CompilePixelMask
+  argus_ros::PixelMask pixel_mask;
+  argus_ros::FrameInputs in;
+};
+
+void RandomFrame(std::mt19937& rng, int width, int height, bool masked,
+                 bool sparse_mask, bool gated, Frame& f) {
+  std::uniform_real_distribution<float> coord(-5.f, 5.f);
+  std::uniform_real_distribution<float> depth(0.f, 12.f);
+  std::uniform_real_distribution<float> noise(0.f, 0.05f);
+  std::uniform_int_distribution<int> pick(0, 15);
+
+  f = Frame();
+  f.width = width;
+  f.height = height;
+  f.in.width = width;
+  f.in.height = height;
+  if (gated) {
+    f.in.min_confidence = 1 + rng() % 200;
+    f.in.min_range = std::uniform_real_distribution<float>(0.f, 3.f)(rng);
+    f.in.max_range =
+        f.in.min_range + std::uniform_real_distribution<float>(0.f, 6.f)(rng);
+    f.in.max_noise = std::uniform_real_distribution<float>(0.f, 0.05f)(rng);
+  }
+
+  f.points.resize(width * height);
+  for (argus::DepthPoint& p : f.points) {
+    p.x = coord(rng);
+    p.y = coord(rng);
+    p.z = depth(rng);
+    p.noise = noise(rng);
+    p.grayValue = rng() % 65536;
+    p.depthConfidence = rng() % 256;
+
+    switch (pick(rng)) {
+      case 0:
+        p.depthConfidence = 0;
+        break;
+      case 1:
+        p.z = NaN_;
+        break;
+      case 2:
+        p.x = NaN_;
+        break;
+      case 3:
+        p.y = Inf_;
+        break;
+      case 4:
+        p.z = f.in.min_range;
+        break;
+      case 5:
+        p.z = f.in.max_range;
+        break;
+      case 6:
+        p.noise = f.in.max_noise;
+        break;
+      case 7:
+        p.depthConfidence = f.in.min_confidence;
+        break;
+      case 8:
+        // beyond what fits into 16-bit millimeters
+        p.z = 70.f;
+        break;
+      default:
+        break;
+    }
+  }
+
+  f.mask.resize(width * height);
+  for (float& m : f.mask) {
+    m = sparse_mask ? ((rng() % 40 == 0) ? 1.f : 0.f) : (rng() % 10) / 10.f;
+  }
+  f.pixel_mask = argus_ros::CompilePixelMask(f.mask.data(), width, height,
+                                             height, 0.5f);
+  f.in.points = f.points.data();
+  f.in.mask = masked ? &f.pixel_mask : nullptr;
+}
+
+//
+// Every plane of a conversion, filled with FILL before the kernel runs
+//
+struct Planes {
+  std::vector<std::uint8_t> gray, conf, noise, xyz, depth, depth_mm, cloud,
+      compact, binned_depth, binned_cloud;
+  std::vector<std::uint32_t> compact_counts;
+  std::size_t ncompact = 0;
+};
+
+Planes Convert(const argus_ros::FrameInputs& in, argus_ros::FrameOutputs out,
+               bool simd, int split) {
+  const std::size_t w = in.width;
+  const std::size_t h = in.height;
+  const std::size_t step = argus_ros::CloudPointStep(out.cloud_layout);
+
+  Planes p;
+  p.gray.assign(w * h * 2, FILL);
+  p.conf.assign(w * h, FILL);
+  p.noise.assign(w * h * 4, FILL);
+  p.xyz.assign(w * h * 12, FILL);
+  p.depth.assign(w * h * 4, FILL);
+  p.depth_mm.assign(w * h * 2, FILL);
+  p.cloud.assign(w * h * step, FILL);
+  p.compact.assign(w * h * step, FILL);
+  p.compact_counts.assign(h, 0);
+
+  out.gray = p.gray.data();
+  out.gray_step = w * 2;
+  out.conf = p.conf.data();
+  out.conf_step = w;
+  out.noise = p.noise.data();
+  out.noise_step = w * 4;
+  out.xyz = p.xyz.data();
+  out.xyz_step = w * 12;
+  out.depth = p.depth.data();
+  out.depth_step = w * 4;
+  out.depth_mm = p.depth_mm.data();
+  out.depth_mm_step = w * 2;
+  out.cloud = p.cloud.data();
+  out.compact = p.compact.data();
+  out.compact_counts = p.compact_counts.data();
+
+  if (out.bin > 0) {
+    const std::size_t bw = w / out.bin;
+    const std::size_t bh = h / out.bin;
+    p.binned_depth.assign(bw * bh * 4, FILL);
+    p.binned_cloud.assign(bw * bh * 16, FILL);
+    out.binned_depth = p.binned_depth.data();
+    out.binned_depth_step = bw * 4;
+    out.binned_cloud = p.binned_cloud.data();
+  }
+
+  argus_ros::SelectConversionKernel(simd);
+  argus_ros::ConvertRows(in, out, 0, split);
+  argus_ros::ConvertRows(in, out, split, in.height);
+  p.ncompact = argus_ros::CompactRows(in, out);
+  p.compact.resize(p.ncompact * step);
+  return p;
+}
+
+template <typename T>
+T At(const std::vector<std::uint8_t>& plane, std::size_t i) {
+  T v;
+  std::memcpy(&v, plane.data() + i * sizeof(T), sizeof(T));
+  return v;
+}
+
+argus::DepthPoint Point(float x, float y, float z, std::uint16_t gray,
+                        std::uint8_t conf) {
+  argus::DepthPoint p = argus::DepthPoint();
+  p.x = x;
+  p.y = y;
+  p.z = z;
+  p.noise = 0.01f;
+  p.grayValue = gray;
+  p.depthConfidence = conf;
+  return p;
+}
+
+void ExpectSame(const Planes& scalar, const Planes& simd,
+                const std::string& what) {
+  EXPECT_EQ(scalar.gray, simd.gray) << what;
+  EXPECT_EQ(scalar.conf, simd.conf) << what;
+  EXPECT_EQ(scalar.noise, simd.noise) << what;
+  EXPECT_EQ(scalar.xyz, simd.xyz) << what;
+  EXPECT_EQ(scalar.depth, simd.depth) << what;
+  EXPECT_EQ(scalar.depth_mm, simd.depth_mm) << what;
+  EXPECT_EQ(scalar.cloud, simd.cloud) << what;
+  EXPECT_EQ(scalar.ncompact, simd.ncompact) << what;
+  EXPECT_EQ(scalar.compact, simd.compact) << what;
+  EXPECT_EQ(scalar.binned_depth, simd.binned_depth) << what;
+  EXPECT_EQ(scalar.binned_cloud, simd.binned_cloud) << what;
+}
+
+}  // end: anonymous namespace
+
+TEST(Conversion, MatchesBaseline) {
+  // 6 wide, so the SIMD kernels convert columns 0 - 3 and their scalar tail
+  // the rest
+  const int width = 6;
+  const int height = 2;
+  std::vector<argus::DepthPoint> points = {
+      Point(1.f, 2.f, 3.f, 100, 200),        Point(1.f, 2.f, 3.f, 101, 0),
+      Point(-0.5f, 0.25f, 1.2346f, 102, 1),  Point(0.f, 0.f, 2.0004f, 103, 9),
+      Point(0.f, 0.f, 70.f, 104, 255),       Point(0.f, 0.f, 0.4f, 105, 7),
+      Point(0.f, 0.f, 6.5f, 106, 7),         Point(0.f, 0.f, 6.f, 107, 7),
+      Point(0.f, 0.f, 0.5f, 108, 7),         Point(0.f, 0.f, 0.f, 109, 0),
+      Point(0.f, 0.f, 1.f, 110, 7),          Point(1.f, -1.f, 1.f, 111, 7)};
+  // masks out the last pixel
+  std::vector<float> mask(width * height, 0.f);
+  mask[(width - 1) * height + 1] = 1.f;
+  argus_ros::PixelMask pixel_mask =
+      argus_ros::CompilePixelMask(mask.data(), width, height, height, 0.5f);
+
+  argus_ros::FrameInputs in;
+  in.points = points.data();
+  in.width = width;
+  in.height = height;
+  in.mask = &pixel_mask;
+
+  for (bool simd : {false, true}) {
+    argus_ros::FrameOutputs out;
+    out.cloud_layout = argus_ros::CloudLayout::XYZI;
+    Planes p = Convert(in, out, simd, 1);
+
+    for (int i = 0; i < width * height; ++i) {
+      const argus::DepthPoint& pt = points[i];
+      bool valid = (pt.depthConfidence > 0) && (i != width * height - 1);
+      EXPECT_EQ(pt.grayValue, At<std::uint16_t>(p.gray, i)) << i;
+      EXPECT_EQ(pt.depthConfidence, p.conf[i]) << i;
+      EXPECT_EQ(pt.noise, At<float>(p.noise, i)) << i;
+
+      if (!valid) {
+        EXPECT_EQ(0.f, At<float>(p.depth, i)) << i;
+        EXPECT_EQ(0, At<std::uint16_t>(p.depth_mm, i)) << i;
+        for (int k = 0; k < 3; ++k) {
+          EXPECT_TRUE(std::isnan(At<float>(p.xyz, 3 * i + k))) << i;
+        }
+        for (int k = 0; k < 4; ++k) {
+          EXPECT_TRUE(std::isnan(At<float>(p.cloud, 4 * i + k))) << i;
+        }
+        continue;
+      }
+
+      // sensor frame: (z, -x, -y)
+      EXPECT_EQ(pt.z, At<float>(p.depth, i)) << i;
+      EXPECT_EQ(pt.z, At<float>(p.xyz, 3 * i)) << i;
+      EXPECT_EQ(-pt.x, At<float>(p.xyz, 3 * i + 1)) << i;
+      EXPECT_EQ(-pt.y, At<float>(p.xyz, 3 * i + 2)) << i;
+      EXPECT_EQ(pt.z, At<float>(p.cloud, 4 * i)) << i;
+      EXPECT_EQ(-pt.x, At<float>(p.cloud, 4 * i + 1)) << i;
+      EXPECT_EQ(-pt.y, At<float>(p.cloud, 4 * i + 2)) << i;
+      EXPECT_EQ(pt.grayValue, At<float>(p.cloud, 4 * i + 3)) << i;
+    }
+
+    // rounded to the nearest millimeter, 0 beyond 65.535m
+    EXPECT_EQ(3000, At<std::uint16_t>(p.depth_mm, 0));
+    EXPECT_EQ(1235, At<std::uint16_t>(p.depth_mm, 2));
+    EXPECT_EQ(2000, At<std::uint16_t>(p.depth_mm, 3));
+    EXPECT_EQ(0, At<std::uint16_t>(p.depth_mm, 4));
+    EXPECT_EQ(400, At<std::uint16_t>(p.depth_mm, 5));
+
+    // and 0 outside of the configured range
+    out.depth_mm_min = 0.5f;
+    out.depth_mm_max = 6.f;
+    p = Convert(in, out, simd, 1);
+    const std::uint16_t clipped[] = {3000, 0, 1235, 2000, 0, 0,
+                                     0,    6000, 500, 0,  1000, 0};
+    for (int i = 0; i < width * height; ++i) {
+      EXPECT_EQ(clipped[i], At<std::uint16_t>(p.depth_mm, i)) << i;
+    }
+  }
+}
+
+TEST(Conversion, SimdMatchesScalar) {
+  RecordProperty("simd_kernel", argus_ros::SelectConversionKernel(true));
+
+  std::mt19937 rng(1);
+  const argus_ros::CloudLayout layouts[] = {argus_ros::CloudLayout::XYZ,
+                                            argus_ros::CloudLayout::XYZI,
+                                            argus_ros::CloudLayout::XYZINC};
+  const float mm_bounds[][2] = {{0.f, 65.535f}, {0.5f, 6.f}, {3.f, 3.f}};
+
+  for (int iter = 0; iter < 300; ++iter) {
+    // odd widths exercise the scalar tail of the SIMD kernels
+    int width = 1 + rng() % 70;
+    int height = 1 + rng() % 12;
+    Frame f;
+    RandomFrame(rng, width, height, iter % 3 != 0, iter % 2 == 0,
+                iter % 4 != 0, f);
+
+    argus_ros::FrameOutputs out;
+    out.cloud_layout = layouts[iter % 3];
+    out.depth_mm_min = mm_bounds[iter % 3][0];
+    out.depth_mm_max = mm_bounds[iter % 3][1];
+    int split = rng() % (height + 1);
+
+    ExpectSame(Convert(f.in, out, false, split),
+               Convert(f.in, out, true, split),
+               "iteration " + std::to_string(iter) + ", " +
+                   std::to_string(width) + "x" + std::to_string(height));
+    if (HasFailure()) {
+      break;
+    }
+  }
+}
+
+TEST(Conversion, BinnedSimdMatchesScalar) {
+  std::mt19937 rng(2);
+  const argus_ros::BinMethod methods[] = {argus_ros::BinMethod::MEAN,
+                                          argus_ros::BinMethod::MIN,
+                                          argus_ros::BinMethod::MEDIAN};
+
+  for (int iter = 0; iter < 300; ++iter) {
+    argus_ros::FrameOutputs out;
+    out.bin = 2 + iter % (argus_ros::MAX_BIN - 1);
+    out.bin_method = methods[iter % 3];
+    out.cloud_layout = argus_ros::CloudLayout::XYZI;
+
+    int width = out.bin + rng() % 50;
+    int height = out.bin + rng() % 40;
+    Frame f;
+    RandomFrame(rng, width, height, iter % 2 == 0, iter % 4 < 2,
+                iter % 3 != 0, f);
+    int split = rng() % (height + 1);
+
+    ExpectSame(Convert(f.in, out, false, split),
+               Convert(f.in, out, true, split),
+               "iteration " + std::to_string(iter) + ", bin " +
+                   std::to_string(out.bin));
+    if (HasFailure()) {
+      break;
+    }
+  }
+}
+
+TEST(Conversion, CompactPointsAreFinite) {
+  // the compact cloud is published as dense
+  std::mt19937 rng(3);
+  for (int iter = 0; iter < 100; ++iter) {
+    int width = 1 + rng() % 70;
+    int height = 1 + rng() % 12;
+    Frame f;
+    RandomFrame(rng, width, height, iter % 2 == 0, iter % 4 < 2,
+                iter % 3 != 0, f);
+
+    std::size_t nvalid = 0;
+    for (int r = 0; r < height; ++r) {
+      for (int c = 0; c < width; ++c) {
+        nvalid += argus_ros::IsValidPixel(f.in, r, c) ? 1 : 0;
+      }
+    }
+
+    for (bool simd : {false, true}) {
+      argus_ros::FrameOutputs out;
+      out.cloud_layout = argus_ros::CloudLayout::XYZI;
+      Planes p = Convert(f.in, out, simd, height / 2);
+
+      // the kernels and IsValidPixel agree on what is valid
+      EXPECT_EQ(nvalid, p.ncompact) << "iteration " << iter;
+      const float* pts = reinterpret_cast<const float*>(p.compact.data());
+      for (std::size_t i = 0; i < 4 * p.ncompact; ++i) {
+        EXPECT_TRUE(std::isfinite(pts[i]))
+            << "iteration " << iter << ", point " << i / 4;
+      }
+    }
+    if (HasFailure()) {
+      break;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
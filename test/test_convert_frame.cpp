@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Once a stream's pools, buffers and filters have been sized by its first
+// frames, converting a frame must not touch the heap. The global operator
+// new is replaced to count every allocation of the process, including those
+// made on the worker pool's threads.
+//
+
+#include <argus_ros/camera_nodelet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <argus_ros/scan.h>
+#include <argus_ros/temporal_filter.h>
+#include <argus_ros/worker_pool.h>
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+
+namespace {
+std::atomic<bool> counting_(false);
+std::atomic<std::size_t> allocations_(0);
+
+}  // end: anonymous namespace
+
+void* operator new(std::size_t size) {
+  if (counting_.load(std::memory_order_relaxed)) {
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* ptr = std::malloc(size ? size : 1);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace argus_ros {
+class ConvertFrameTest : public testing::Test {
+ protected:
+  static const int WIDTH = 224;
+  static const int HEIGHT = 172;
+  static const int POOL_SIZE = 6;
+
+  void SetUp() override {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    // a pinhole-ish lens, and a wall with some texture 2m in front of it
+    std::vector<argus::DepthPoint> uvec(WIDTH * HEIGHT);
+    this->points_.resize(WIDTH * HEIGHT);
+    for (int r = 0; r < HEIGHT; ++r) {
+      for (int c = 0; c < WIDTH; ++c) {
+        float x = (c - WIDTH / 2 + 0.5f) / 200.f;
+        float y = (r - HEIGHT / 2 + 0.5f) / 200.f;
+        float n = std::sqrt(x * x + y * y + 1.f);
+        argus::DepthPoint& u = uvec[r * WIDTH + c];
+        u = argus::DepthPoint();
+        u.x = x / n;
+        u.y = y / n;
+        u.z = 1.f / n;
+
+        float z = 2.f + 0.01f * unit(rng);
+        argus::DepthPoint& p = this->points_[r * WIDTH + c];
+        p = argus::DepthPoint();
+        p.x = x * z;
+        p.y = y * z;
+        p.z = z;
+        p.noise = 0.005f;
+        p.grayValue = 500 + (rng() % 500);
+        p.depthConfidence = (rng() % 20 == 0) ? 0 : 255;
+      }
+    }
+
+    std::vector<float> mask(WIDTH * HEIGHT, 0.f);
+    for (std::size_t i = 0; i < mask.size(); i += 97) {
+      mask[i] = 1.f;
+    }
+
+    CameraNodelet::FrameConfig cfg;
+    cfg.use_case = "MODE_9_5FPS";
+    cfg.stream_index.assign(1, 0);
+    cfg.intrinsics.width = WIDTH;
+    cfg.intrinsics.height = HEIGHT;
+    cfg.intrinsics.distortion_model = "plumb_bob";
+    cfg.intrinsics.D.assign(5, 0.);
+    cfg.uvec_width = WIDTH;
+    cfg.uvec_height = HEIGHT;
+    cfg.mask = std::make_shared<PixelMask>(
+        CompilePixelMask(mask.data(), WIDTH, HEIGHT, HEIGHT, 0.5f));
+    cfg.mask_width = WIDTH;
+    cfg.mask_height = HEIGHT;
+    // both longer than std::string's inline buffer
+    cfg.optical_frame = "camera_optical_link";
+    cfg.sensor_frame = "camera_sensor_link_";
+    cfg.spatial.iterations = 2;
+    cfg.temporal.mode = TemporalMode::MEDIAN;
+    cfg.scan_table = std::make_shared<ScanTable>(BuildScanTable(
+        uvec.data(), WIDTH, 0, 0, WIDTH, HEIGHT, cfg.scan));
+    cfg.bin = 2;
+    this->nodelet_.frame_config_ =
+        std::make_shared<const CameraNodelet::FrameConfig>(cfg);
+
+    this->nodelet_.pool_.reset(new WorkerPool(2, std::vector<int>()));
+    this->nodelet_.stream_buffers_.emplace_back(
+        new CameraNodelet::StreamBuffers(POOL_SIZE));
+
+    this->want_.info = true;
+    this->want_.exposure = true;
+    this->want_.gray = true;
+    this->want_.conf = true;
+    this->want_.noise = true;
+    this->want_.xyz = true;
+    this->want_.depth = true;
+    this->want_.depth_mm = true;
+    this->want_.cloud = true;
+    this->want_.compact = true;
+    this->want_.voxel = true;
+    this->want_.normals = true;
+    this->want_.scan = true;
+    this->want_.binned_info = true;
+    this->want_.binned_depth = true;
+    this->want_.binned_cloud = true;
+
+    this->frame_.streamId = 0;
+    this->frame_.width = WIDTH;
+    this->frame_.height = HEIGHT;
+    this->frame_.full_width = WIDTH;
+    this->frame_.full_height = HEIGHT;
+    this->frame_.exposureTimes.assign(2, 1000);
+    this->frame_.points.reserve(this->points_.size());
+    this->frame_.config = this->nodelet_.frame_config_;
+  }
+
+  //
+  // Converts `n` frames with every product wanted, dropping the messages
+  // right away like the publisher does. Returns the number of allocations
+  // made meanwhile.
+  //
+  std::size_t Convert(int n) {
+    allocations_ = 0;
+    counting_ = true;
+    for (int i = 0; i < n; ++i) {
+      this->frame_.timeStamp = std::chrono::microseconds(100000 * i);
+      this->frame_.points.assign(this->points_.begin(), this->points_.end());
+      bool any = this->nodelet_.ConvertFrame(0, this->want_, this->frame_,
+                                             this->products_);
+      EXPECT_TRUE(any);
+      EXPECT_TRUE(this->products_.voxel_cloud != nullptr);
+      EXPECT_TRUE(this->products_.scan != nullptr);
+      EXPECT_TRUE(this->products_.binned_cloud != nullptr);
+      this->products_ = CameraNodelet::Products();
+    }
+    counting_ = false;
+    return allocations_;
+  }
+
+  //
+  // Converts `n` frames and keeps all of their messages, like a subscriber
+  // that does not keep up. Returns the number of messages the pools could
+  // not provide.
+  //
+  std::size_t ConvertAndHold(int n) {
+    std::vector<CameraNodelet::Products> held;
+    for (int i = 0; i < n; ++i) {
+      this->frame_.points.assign(this->points_.begin(), this->points_.end());
+      this->nodelet_.ConvertFrame(0, this->want_, this->frame_,
+                                  this->products_);
+      held.push_back(this->products_);
+      this->products_ = CameraNodelet::Products();
+    }
+    return this->nodelet_.stream_buffers_[0]->PoolMisses();
+  }
+
+  //
+  // Swaps in the configuration of another resolution, as the SDK callback
+  // does on a use case change
+  //
+  void ChangeUseCase() {
+    auto cfg = std::make_shared<CameraNodelet::FrameConfig>(
+        *this->nodelet_.frame_config_);
+    cfg->use_case = "MODE_5_45FPS";
+    cfg->uvec_width = 352;
+    cfg->uvec_height = 287;
+    cfg->mask.reset();
+    cfg->scan_table.reset();
+    this->nodelet_.frame_config_ = cfg;
+  }
+
+  std::vector<argus::DepthPoint> points_;
+  CameraNodelet nodelet_;
+  CameraNodelet::Wants want_;
+  CameraNodelet::Frame frame_;
+  CameraNodelet::Products products_;
+};
+
+TEST_F(ConvertFrameTest, SteadyStateDoesNotAllocate) {
+  // the first frames size everything
+  this->Convert(3);
+  EXPECT_EQ(0u, this->Convert(50));
+}
+
+TEST_F(ConvertFrameTest, CountsMessagesBeyondThePools) {
+  EXPECT_EQ(0u, this->ConvertAndHold(POOL_SIZE));
+  EXPECT_LT(0u, this->ConvertAndHold(POOL_SIZE + 1));
+}
+
+TEST_F(ConvertFrameTest, UsesTheConfigOfTheFrame) {
+  // a use case change while the frame was queued
+  this->ChangeUseCase();
+  this->Convert(1);
+}
+
+}  // end: namespace argus_ros
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_convert_frame");
+  return RUN_ALL_TESTS();
+}
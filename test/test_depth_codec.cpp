@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// The codecs of the "lossless" transport must round trip every image
+// exactly, and their decoders, which take input off the network, must
+// reject whatever does not decode to exactly the expected image without
+// writing past it.
+//
+
+#include <argus_ros/depth_codec.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+// written behind each decoded image, must be left alone
+const std::size_t GUARD = 64;
+const std::uint8_t GUARD_BYTE = 0xA5;
+
+// sizes around the SIMD widths and the nibble words, and a full frame
+const std::size_t SIZES[] = {0, 1, 2, 3, 7, 8, 9, 17, 63, 1001, 224 * 172};
+
+//
+// A depth image in millimeters: valid runs with small and huge deltas, and
+// runs of invalid (zero) pixels
+//
+std::vector<std::uint16_t> DepthMM(std::mt19937& rng, std::size_t n) {
+  std::vector<std::uint16_t> mm(n);
+  std::uint16_t v = 2000;
+  for (std::uint16_t& p : mm) {
+    switch (rng() % 8) {
+      case 0:
+        p = 0;
+        continue;
+      case 1:
+        v = static_cast<std::uint16_t>(rng());
+        break;
+      default:
+        v = static_cast<std::uint16_t>(v + static_cast<int>(rng() % 21) - 10);
+        break;
+    }
+    p = v;
+  }
+  return mm;
+}
+
+std::vector<float> Floats(std::mt19937& rng, std::size_t n) {
+  std::uniform_real_distribution<float> depth(0.1f, 8.f);
+  std::vector<float> f(n);
+  for (float& v : f) {
+    v = (rng() % 10 == 0) ? std::numeric_limits<float>::quiet_NaN()
+                          : depth(rng);
+  }
+  return f;
+}
+
+// Decodes RVL into `n` pixels followed by a guard, false if that fails or
+// the guard was touched
+bool DecodeRVL(const std::vector<std::uint8_t>& packed, std::size_t n,
+               std::vector<std::uint16_t>& out) {
+  std::vector<std::uint8_t> buf(n * 2 + GUARD, GUARD_BYTE);
+  bool ok = argus_ros::DecodeRVL(packed.data(), packed.size(),
+                                 reinterpret_cast<std::uint16_t*>(buf.data()),
+                                 n);
+  for (std::size_t i = n * 2; i < buf.size(); ++i) {
+    EXPECT_EQ(GUARD_BYTE, buf[i]) << "RVL wrote past " << n << " pixels";
+  }
+  out.assign(reinterpret_cast<const std::uint16_t*>(buf.data()),
+             reinterpret_cast<const std::uint16_t*>(buf.data()) + n);
+  return ok;
+}
+
+bool DecodeLZ4(const std::vector<std::uint8_t>& packed, std::size_t n,
+               std::size_t elem_size, std::vector<std::uint8_t>& out) {
+  std::vector<std::uint8_t> buf(n * elem_size + GUARD, GUARD_BYTE);
+  std::vector<std::uint8_t> scratch;
+  bool ok = argus_ros::DecodeShuffleLZ4(packed.data(), packed.size(),
+                                        buf.data(), n, elem_size, scratch);
+  for (std::size_t i = n * elem_size; i < buf.size(); ++i) {
+    EXPECT_EQ(GUARD_BYTE, buf[i]) << "LZ4 wrote past " << n << " elements";
+  }
+  out.assign(buf.begin(), buf.begin() + n * elem_size);
+  return ok;
+}
+
+}  // end: anonymous namespace
+
+TEST(DepthCodec, RVLRoundTrip) {
+  std::mt19937 rng(1);
+  for (std::size_t n : SIZES) {
+    std::vector<std::uint16_t> mm = DepthMM(rng, n);
+    std::vector<std::uint8_t> packed;
+    argus_ros::EncodeRVL(mm.data(), n, packed);
+
+    std::vector<std::uint16_t> out;
+    EXPECT_TRUE(DecodeRVL(packed, n, out)) << n << " pixels";
+    EXPECT_EQ(mm, out) << n << " pixels";
+  }
+}
+
+TEST(DepthCodec, RVLUniformFrames) {
+  for (std::uint16_t v : {0, 1, 0xFFFF}) {
+    // all invalid, all nearest and all farthest
+    std::vector<std::uint16_t> mm(224 * 172, v);
+    std::vector<std::uint8_t> packed;
+    argus_ros::EncodeRVL(mm.data(), mm.size(), packed);
+    if (v == 0) {
+      EXPECT_GE(16u, packed.size());
+    }
+
+    std::vector<std::uint16_t> out;
+    EXPECT_TRUE(DecodeRVL(packed, mm.size(), out)) << "value " << v;
+    EXPECT_EQ(mm, out) << "value " << v;
+  }
+}
+
+TEST(DepthCodec, RVLRejectsBadInput) {
+  std::mt19937 rng(2);
+  const std::size_t n = 1001;
+  std::vector<std::uint16_t> mm = DepthMM(rng, n);
+  std::vector<std::uint8_t> packed;
+  argus_ros::EncodeRVL(mm.data(), n, packed);
+  std::vector<std::uint16_t> out;
+
+  // another frame size
+  for (std::size_t m : {n - 1, n + 1, n / 2, 2 * n}) {
+    EXPECT_FALSE(DecodeRVL(packed, m, out)) << m << " pixels";
+  }
+
+  // cut short
+  for (std::size_t len = 0; len < packed.size(); ++len) {
+    std::vector<std::uint8_t> cut(packed.begin(), packed.begin() + len);
+    EXPECT_FALSE(DecodeRVL(cut, n, out)) << len << " bytes";
+  }
+
+  // trailing data
+  std::vector<std::uint8_t> longer(packed);
+  longer.insert(longer.end(), {0x12, 0x34, 0x56, 0x78});
+  EXPECT_FALSE(DecodeRVL(longer, n, out));
+
+  // corrupted or garbage data may decode to anything, but must stay within
+  // the image
+  for (int i = 0; i < 2000; ++i) {
+    std::vector<std::uint8_t> bad(packed);
+    if (i % 2) {
+      for (std::uint8_t& b : bad) {
+        b = static_cast<std::uint8_t>(rng());
+      }
+    } else {
+      bad[rng() % bad.size()] ^= static_cast<std::uint8_t>(1 + rng() % 255);
+    }
+    DecodeRVL(bad, n, out);
+  }
+}
+
+TEST(DepthCodec, ShuffleLZ4RoundTrip) {
+  std::mt19937 rng(3);
+  for (std::size_t n : SIZES) {
+    std::vector<float> f = Floats(rng, 3 * n);
+    const std::uint8_t* raw = reinterpret_cast<const std::uint8_t*>(f.data());
+    std::vector<std::uint8_t> expected(raw, raw + f.size() * sizeof(float));
+
+    for (std::size_t elem_size : {std::size_t(1), std::size_t(2),
+                                  std::size_t(4), std::size_t(12)}) {
+      std::size_t m = expected.size() / elem_size;
+      std::vector<std::uint8_t> packed, scratch, out;
+      argus_ros::EncodeShuffleLZ4(raw, m, elem_size, packed, scratch);
+      EXPECT_TRUE(DecodeLZ4(packed, m, elem_size, out))
+          << n << " points, elements of " << elem_size;
+      EXPECT_EQ(expected, out) << n << " points, elements of " << elem_size;
+    }
+  }
+}
+
+TEST(DepthCodec, ShuffleLZ4UniformFrames) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (float v : {0.f, nan}) {
+    // all zero and all invalid
+    std::vector<float> f(224 * 172, v);
+    const std::uint8_t* raw = reinterpret_cast<const std::uint8_t*>(f.data());
+    std::vector<std::uint8_t> packed, scratch, out;
+    argus_ros::EncodeShuffleLZ4(raw, f.size(), sizeof(float), packed,
+                                scratch);
+    EXPECT_GT(f.size() * sizeof(float) / 100, packed.size());
+
+    EXPECT_TRUE(DecodeLZ4(packed, f.size(), sizeof(float), out));
+    EXPECT_EQ(0, std::memcmp(out.data(), raw, out.size()));
+  }
+}
+
+TEST(DepthCodec, ShuffleLZ4RejectsBadInput) {
+  std::mt19937 rng(4);
+  const std::size_t n = 1001;
+  std::vector<float> f = Floats(rng, n);
+  std::vector<std::uint8_t> packed, scratch, out;
+  argus_ros::EncodeShuffleLZ4(reinterpret_cast<const std::uint8_t*>(f.data()),
+                              n, sizeof(float), packed, scratch);
+
+  for (std::size_t m : {n - 1, n + 1, n / 2, 2 * n}) {
+    EXPECT_FALSE(DecodeLZ4(packed, m, sizeof(float), out)) << m << " floats";
+  }
+  EXPECT_FALSE(DecodeLZ4(packed, n, 0, out));
+
+  for (std::size_t len = 0; len < packed.size(); ++len) {
+    std::vector<std::uint8_t> cut(packed.begin(), packed.begin() + len);
+    EXPECT_FALSE(DecodeLZ4(cut, n, sizeof(float), out)) << len << " bytes";
+  }
+
+  for (int i = 0; i < 2000; ++i) {
+    std::vector<std::uint8_t> bad(packed);
+    if (i % 2) {
+      for (std::uint8_t& b : bad) {
+        b = static_cast<std::uint8_t>(rng());
+      }
+    } else {
+      bad[rng() % bad.size()] ^= static_cast<std::uint8_t>(1 + rng() % 255);
+    }
+    DecodeLZ4(bad, n, sizeof(float), out);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
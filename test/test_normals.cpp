@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Normals of surfaces seen through a pinhole camera: a plane and a sphere
+// against their known normals, and a noisy scene against a brute-force
+// covariance and Jacobi eigen decomposition of every window.
+//
+
+#include <argus_ros/normals.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <gtest/gtest.h>
+
+namespace {
+const int WIDTH = 64;
+const int HEIGHT = 48;
+const float FOCAL = 60.f;  // pixels
+const float NaN_ = std::numeric_limits<float>::quiet_NaN();
+
+struct Vec3 {
+  double x, y, z;
+};
+
+double Dot(const Vec3& a, const Vec3& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//
+// A frame of the surface that `hit` finds along each pixel's ray (optical
+// frame: x right, y down, z forward), false where the ray misses it
+//
+std::vector<argus::DepthPoint> Render(
+    const std::function<bool(const Vec3&, Vec3&)>& hit) {
+  std::vector<argus::DepthPoint> points(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < WIDTH; ++c) {
+      Vec3 ray = {(c - WIDTH / 2 + 0.5) / FOCAL,
+                  (r - HEIGHT / 2 + 0.5) / FOCAL, 1.};
+      Vec3 p;
+      argus::DepthPoint& pt = points[r * WIDTH + c];
+      pt = argus::DepthPoint();
+      if (hit(ray, p)) {
+        pt.x = p.x;
+        pt.y = p.y;
+        pt.z = p.z;
+        pt.depthConfidence = 255;
+      } else {
+        pt.x = pt.y = pt.z = NaN_;
+      }
+    }
+  }
+  return points;
+}
+
+argus_ros::FrameInputs Inputs(const std::vector<argus::DepthPoint>& points) {
+  argus_ros::FrameInputs in;
+  in.points = points.data();
+  in.width = WIDTH;
+  in.height = HEIGHT;
+  return in;
+}
+
+std::vector<float> Normals(const argus_ros::FrameInputs& in, int window) {
+  std::vector<float> out(WIDTH * HEIGHT * 4);
+  argus_ros::NormalEstimator normals;
+  normals.Integrate(in);
+  normals.Rows(in, window, 0, HEIGHT,
+               reinterpret_cast<std::uint8_t*>(out.data()),
+               WIDTH * 4 * sizeof(float));
+  return out;
+}
+
+// the optical frame point `p` in the sensor frame of the cloud
+Vec3 Sensor(const Vec3& p) { return Vec3{p.z, -p.x, -p.y}; }
+
+//
+// Eigenvalues (ascending) and eigenvectors (columns of `v`) of the
+// symmetric `c` by cyclic Jacobi rotations
+//
+void Jacobi(double c[3][3], double eig[3], double v[3][3]) {
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      v[i][j] = (i == j) ? 1. : 0.;
+    }
+  }
+  for (int sweep = 0; sweep < 50; ++sweep) {
+    double off = c[0][1] * c[0][1] + c[0][2] * c[0][2] + c[1][2] * c[1][2];
+    if (off < 1e-300) {
+      break;
+    }
+    for (int p = 0; p < 2; ++p) {
+      for (int q = p + 1; q < 3; ++q) {
+        if (c[p][q] == 0.) {
+          continue;
+        }
+        double theta = (c[q][q] - c[p][p]) / (2. * c[p][q]);
+        double t = (theta >= 0. ? 1. : -1.) /
+                   (std::fabs(theta) + std::sqrt(theta * theta + 1.));
+        double cs = 1. / std::sqrt(t * t + 1.);
+        double sn = t * cs;
+        for (int k = 0; k < 3; ++k) {
+          double kp = c[k][p], kq = c[k][q];
+          c[k][p] = cs * kp - sn * kq;
+          c[k][q] = sn * kp + cs * kq;
+        }
+        for (int k = 0; k < 3; ++k) {
+          double pk = c[p][k], qk = c[q][k];
+          c[p][k] = cs * pk - sn * qk;
+          c[q][k] = sn * pk + cs * qk;
+        }
+        for (int k = 0; k < 3; ++k) {
+          double kp = v[k][p], kq = v[k][q];
+          v[k][p] = cs * kp - sn * kq;
+          v[k][q] = sn * kp + cs * kq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    eig[i] = c[i][i];
+  }
+}
+
+}  // end: anonymous namespace
+
+TEST(Normals, Plane) {
+  // tilted to the right and up, 2m in front of the camera
+  Vec3 n = {0.3, -0.2, -1.};
+  double len = std::sqrt(Dot(n, n));
+  n = Vec3{n.x / len, n.y / len, n.z / len};
+  const double dist = -2.;  // Dot(n, p) on the plane
+  std::vector<argus::DepthPoint> points =
+      Render([&n, dist](const Vec3& ray, Vec3& p) {
+        double t = dist / Dot(n, ray);
+        p = Vec3{t * ray.x, t * ray.y, t * ray.z};
+        return true;
+      });
+
+  // n faces the camera, which sits at the origin
+  const Vec3 expected = Sensor(n);
+  for (int window : {3, 7, 15}) {
+    std::vector<float> out = Normals(Inputs(points), window);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+      const float* o = &out[4 * i];
+      ASSERT_NEAR(expected.x, o[0], 1e-4) << "pixel " << i;
+      ASSERT_NEAR(expected.y, o[1], 1e-4) << "pixel " << i;
+      ASSERT_NEAR(expected.z, o[2], 1e-4) << "pixel " << i;
+      ASSERT_LE(0.f, o[3]) << "pixel " << i;
+      ASSERT_GT(1e-6f, o[3]) << "pixel " << i;
+    }
+  }
+}
+
+TEST(Normals, Sphere) {
+  // radius 0.5m, 2m in front of the camera; the rays through the corners
+  // of the frame miss it
+  const Vec3 center = {0., 0., 2.};
+  const double radius = 0.5;
+  std::vector<argus::DepthPoint> points =
+      Render([&center, radius](const Vec3& ray, Vec3& p) {
+        double a = Dot(ray, ray);
+        double b = Dot(ray, center);
+        double disc = b * b - a * (Dot(center, center) - radius * radius);
+        if (disc < 0.) {
+          return false;
+        }
+        double t = (b - std::sqrt(disc)) / a;
+        p = Vec3{t * ray.x, t * ray.y, t * ray.z};
+        return true;
+      });
+  argus_ros::FrameInputs in = Inputs(points);
+
+  const int window = 5;
+  std::vector<float> out = Normals(in, window);
+  int checked = 0;
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < WIDTH; ++c) {
+      const argus::DepthPoint& p = points[r * WIDTH + c];
+      const float* o = &out[4 * (r * WIDTH + c)];
+      if (!argus_ros::IsValidPixel(in, r, c)) {
+        EXPECT_TRUE(std::isnan(o[0]) && std::isnan(o[3]));
+        continue;
+      }
+
+      // where the sphere faces the camera, away from the rim
+      Vec3 radial = {(p.x - center.x) / radius, (p.y - center.y) / radius,
+                     (p.z - center.z) / radius};
+      Vec3 view = {p.x, p.y, p.z};
+      if (-Dot(radial, view) < 0.9 * std::sqrt(Dot(view, view))) {
+        continue;
+      }
+
+      // perspective spreads the points of the window unevenly over the
+      // curved patch, which tilts the fitted plane by a small fraction of
+      // the patch's 0.25 rad
+      Vec3 expected = Sensor(radial);
+      double cos = expected.x * o[0] + expected.y * o[1] + expected.z * o[2];
+      ASSERT_GT(cos, std::cos(0.01)) << "pixel " << r << ", " << c;
+      checked++;
+    }
+  }
+  EXPECT_LT(100, checked);
+
+  // A 5x5 grid of spacing s on a sphere of radius R: the tangential
+  // variances are 2 s^2 each, and the depth s^2 (i^2 + j^2) / 2R varies by
+  // 1.4 s^4 / R^2, so the surface variation is about 0.35 s^2 / R^2
+  const int r = HEIGHT / 2;
+  const int c = WIDTH / 2;
+  double s = points[r * WIDTH + c].z / FOCAL;
+  EXPECT_NEAR(0.35 * s * s / (radius * radius), out[4 * (r * WIDTH + c) + 3],
+              0.05 * 0.35 * s * s / (radius * radius));
+}
+
+TEST(Normals, MatchesBruteForce) {
+  // a noisy, bumpy surface with holes, so that the two smallest eigenvalues
+  // of many windows are close
+  std::mt19937 rng(7);
+  std::normal_distribution<double> noise(0., 0.01);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::vector<argus::DepthPoint> points =
+      Render([&](const Vec3& ray, Vec3& p) {
+        double t = 2. + 0.2 * std::sin(8. * ray.x) * std::cos(6. * ray.y) +
+                   noise(rng);
+        p = Vec3{t * ray.x, t * ray.y, t * ray.z};
+        return uniform(rng) > 0.15;
+      });
+  argus_ros::FrameInputs in = Inputs(points);
+
+  double worst = 0.;
+  for (int window : {3, 7}) {
+    std::vector<float> out = Normals(in, window);
+    const int half = window / 2;
+    for (int r = 0; r < HEIGHT; ++r) {
+      for (int c = 0; c < WIDTH; ++c) {
+        const float* o = &out[4 * (r * WIDTH + c)];
+        if (!argus_ros::IsValidPixel(in, r, c)) {
+          ASSERT_TRUE(std::isnan(o[0]));
+          continue;
+        }
+
+        std::vector<Vec3> pts;
+        for (int rr = std::max(r - half, 0);
+             rr < std::min(r + half + 1, HEIGHT); ++rr) {
+          for (int cc = std::max(c - half, 0);
+               cc < std::min(c + half + 1, WIDTH); ++cc) {
+            if (argus_ros::IsValidPixel(in, rr, cc)) {
+              const argus::DepthPoint& q = points[rr * WIDTH + cc];
+              pts.push_back(Sensor(Vec3{q.x, q.y, q.z}));
+            }
+          }
+        }
+        if (pts.size() < 3) {
+          ASSERT_TRUE(std::isnan(o[0])) << "pixel " << r << ", " << c;
+          continue;
+        }
+
+        Vec3 mean = {0., 0., 0.};
+        for (const Vec3& q : pts) {
+          mean = Vec3{mean.x + q.x, mean.y + q.y, mean.z + q.z};
+        }
+        mean = Vec3{mean.x / pts.size(), mean.y / pts.size(),
+                    mean.z / pts.size()};
+        double cov[3][3] = {};
+        for (const Vec3& q : pts) {
+          double d[3] = {q.x - mean.x, q.y - mean.y, q.z - mean.z};
+          for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+              cov[i][j] += d[i] * d[j] / pts.size();
+            }
+          }
+        }
+        double eig[3], vec[3][3];
+        Jacobi(cov, eig, vec);
+        int k = std::min_element(eig, eig + 3) - eig;
+        double curvature = eig[k] / (eig[0] + eig[1] + eig[2]);
+        std::sort(eig, eig + 3);
+
+        // same orientation rule: towards the sensor
+        const argus::DepthPoint& p = points[r * WIDTH + c];
+        Vec3 n = {vec[0][k], vec[1][k], vec[2][k]};
+        if (Dot(n, Sensor(Vec3{p.x, p.y, p.z})) > 0.) {
+          n = Vec3{-n.x, -n.y, -n.z};
+        }
+
+        // the documented accuracy of the eigenvector, plus float rounding;
+        // the curvature is off by at most the angle squared
+        double ratio = eig[0] / eig[1];
+        double angle = std::min(1.5 * ratio * ratio * ratio, 3.);
+        ASSERT_NEAR(n.x, o[0], angle + 1e-6) << "pixel " << r << ", " << c;
+        ASSERT_NEAR(n.y, o[1], angle + 1e-6) << "pixel " << r << ", " << c;
+        ASSERT_NEAR(n.z, o[2], angle + 1e-6) << "pixel " << r << ", " << c;
+        ASSERT_NEAR(curvature, o[3], angle * angle + 1e-6)
+            << "pixel " << r << ", " << c;
+        worst = std::max(worst, ratio);
+      }
+    }
+  }
+
+  // some windows are all but flat in two directions
+  EXPECT_LT(0.5, worst);
+}
+
+TEST(Normals, BandedIntegrationMatchesSerial) {
+  std::mt19937 rng(9);
+  std::uniform_real_distribution<double> depth(1., 3.);
+  std::vector<argus::DepthPoint> points =
+      Render([&](const Vec3& ray, Vec3& p) {
+        double t = depth(rng);
+        p = Vec3{t * ray.x, t * ray.y, t * ray.z};
+        return rng() % 5 != 0;
+      });
+  argus_ros::FrameInputs in = Inputs(points);
+  std::vector<float> serial = Normals(in, 5);
+
+  // bands in an odd order, as the workers may pick them up
+  argus_ros::NormalEstimator normals;
+  normals.Prepare(in);
+  const int rows[] = {30, 48, 0, 7, 7, 30};
+  for (int i = 0; i < 6; i += 2) {
+    normals.IntegrateRows(in, rows[i], rows[i + 1]);
+  }
+  const int cols[] = {50, 64, 13, 50, 0, 13};
+  for (int i = 0; i < 6; i += 2) {
+    normals.IntegrateColumns(cols[i], cols[i + 1]);
+  }
+  std::vector<float> banded(serial.size());
+  normals.Rows(in, 5, 0, HEIGHT,
+               reinterpret_cast<std::uint8_t*>(banded.data()),
+               WIDTH * 4 * sizeof(float));
+
+  for (std::size_t i = 0; i < serial.size(); ++i) {
+    if (std::isnan(serial[i])) {
+      ASSERT_TRUE(std::isnan(banded[i])) << "value " << i;
+    } else {
+      ASSERT_EQ(serial[i], banded[i]) << "value " << i;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
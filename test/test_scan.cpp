@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// The virtual laser scan of a pinhole camera facing a wall at a known
+// distance: the ranges of the bins against the wall's planar distance, the
+// height band, the range limits, invalid pixels and the banded form against
+// the serial one.
+//
+
+#include <argus_ros/scan.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <gtest/gtest.h>
+
+namespace {
+const int WIDTH = 64;
+const int HEIGHT = 48;
+const float FOCAL = 60.f;  // pixels
+const float WALL = 2.f;    // meters along the optical axis
+const float NaN_ = std::numeric_limits<float>::quiet_NaN();
+const float INF = std::numeric_limits<float>::infinity();
+
+// pixel ray with a unit optical z (optical frame: x right, y down)
+float RayX(int c) { return (c - WIDTH / 2 + 0.5f) / FOCAL; }
+float RayY(int r) { return (r - HEIGHT / 2 + 0.5f) / FOCAL; }
+
+std::vector<argus::DepthPoint> Lens() {
+  std::vector<argus::DepthPoint> uvec(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < WIDTH; ++c) {
+      float x = RayX(c);
+      float y = RayY(r);
+      float n = std::sqrt(x * x + y * y + 1.f);
+      argus::DepthPoint& u = uvec[r * WIDTH + c];
+      u = argus::DepthPoint();
+      u.x = x / n;
+      u.y = y / n;
+      u.z = 1.f / n;
+    }
+  }
+  return uvec;
+}
+
+//
+// A frame whose pixel (r, c) is at optical depth `depth(r, c)`, invalid
+// where that is NaN
+//
+std::vector<argus::DepthPoint> Render(
+    const std::function<float(int, int)>& depth) {
+  std::vector<argus::DepthPoint> points(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < WIDTH; ++c) {
+      float z = depth(r, c);
+      argus::DepthPoint& p = points[r * WIDTH + c];
+      p = argus::DepthPoint();
+      if (std::isnan(z)) {
+        p.x = p.y = p.z = NaN_;
+        continue;
+      }
+      p.x = RayX(c) * z;
+      p.y = RayY(r) * z;
+      p.z = z;
+      p.depthConfidence = 255;
+    }
+  }
+  return points;
+}
+
+argus_ros::FrameInputs Inputs(const std::vector<argus::DepthPoint>& points) {
+  argus_ros::FrameInputs in;
+  in.points = points.data();
+  in.width = WIDTH;
+  in.height = HEIGHT;
+  return in;
+}
+
+argus_ros::ScanTable Table(const argus_ros::ScanParams& params) {
+  std::vector<argus::DepthPoint> uvec = Lens();
+  return argus_ros::BuildScanTable(uvec.data(), WIDTH, 0, 0, WIDTH, HEIGHT,
+                                   params);
+}
+
+std::vector<float> Scan(const std::vector<argus::DepthPoint>& points,
+                        const argus_ros::ScanTable& table,
+                        const argus_ros::ScanParams& params) {
+  std::vector<float> ranges(table.nbins);
+  argus_ros::ProjectScan(Inputs(points), table, params, ranges.data());
+  return ranges;
+}
+
+// the bin of column `c`, whose angle in the sensor frame is -atan(ray x)
+int Bin(const argus_ros::ScanTable& table, int c) {
+  return static_cast<int>(std::lround(
+      (-std::atan(RayX(c)) - table.angle_min) / table.angle_increment));
+}
+
+}  // end: anonymous namespace
+
+TEST(Scan, Table) {
+  argus_ros::ScanParams params;
+  argus_ros::ScanTable table = Table(params);
+
+  EXPECT_EQ(table.width, WIDTH);
+  EXPECT_EQ(table.height, HEIGHT);
+  EXPECT_FLOAT_EQ(table.angle_increment, params.angle_increment);
+  EXPECT_NEAR(table.angle_min, -std::atan(RayX(WIDTH - 1)), 1e-5);
+  EXPECT_NEAR(table.angle_min + (table.nbins - 1) * table.angle_increment,
+              -std::atan(RayX(0)), params.angle_increment);
+
+  // a pinhole's angle only depends on the column
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < WIDTH; ++c) {
+      EXPECT_EQ(table.bins[r * WIDTH + c], Bin(table, c));
+    }
+  }
+
+  // no usable lens direction, no bins
+  std::vector<argus::DepthPoint> behind = Lens();
+  for (argus::DepthPoint& u : behind) {
+    u.z = -u.z;
+  }
+  argus_ros::ScanTable none = argus_ros::BuildScanTable(
+      behind.data(), WIDTH, 0, 0, WIDTH, HEIGHT, params);
+  EXPECT_EQ(none.nbins, 0);
+  for (std::int32_t bin : none.bins) {
+    EXPECT_EQ(bin, -1);
+  }
+}
+
+TEST(Scan, WallAtKnownDistance) {
+  argus_ros::ScanParams params;
+  argus_ros::ScanTable table = Table(params);
+  std::vector<float> ranges =
+      Scan(Render([](int, int) { return WALL; }), table, params);
+
+  // the planar range of column c on the wall is WALL / cos(angle of c)
+  std::vector<bool> hit(table.nbins, false);
+  for (int c = 0; c < WIDTH; ++c) {
+    int bin = Bin(table, c);
+    ASSERT_GE(bin, 0);
+    ASSERT_LT(bin, table.nbins);
+    hit[bin] = true;
+    float x = RayX(c) * WALL;
+    EXPECT_NEAR(ranges[bin], std::sqrt(WALL * WALL + x * x), 1e-5);
+  }
+  // the columns are farther apart than the bins, the rest stay empty
+  for (int i = 0; i < table.nbins; ++i) {
+    if (!hit[i]) {
+      EXPECT_EQ(ranges[i], INF);
+    }
+  }
+}
+
+TEST(Scan, HeightBand) {
+  argus_ros::ScanParams params;
+  params.min_height = -0.04f;
+  params.max_height = 0.04f;
+  argus_ros::ScanTable table = Table(params);
+
+  // a shelf at 1 m above the band (optical y < 0 is up), a box at 1.5 m
+  // in the band over the left columns
+  std::vector<argus::DepthPoint> points = Render([](int r, int c) {
+    if (RayY(r) * 1.f < -0.1f) {
+      return 1.f;
+    }
+    return (c < 8) ? 1.5f : WALL;
+  });
+  std::vector<float> ranges = Scan(points, table, params);
+  for (int c = 0; c < WIDTH; ++c) {
+    float z = (c < 8) ? 1.5f : WALL;
+    float x = RayX(c) * z;
+    EXPECT_NEAR(ranges[Bin(table, c)], std::sqrt(z * z + x * x), 1e-5);
+  }
+
+  // nothing within an empty band
+  params.min_height = 0.5f;
+  params.max_height = 0.6f;
+  for (float r : Scan(points, table, params)) {
+    EXPECT_EQ(r, INF);
+  }
+}
+
+TEST(Scan, RangeLimits) {
+  argus_ros::ScanParams params;
+  argus_ros::ScanTable table = Table(params);
+  std::vector<argus::DepthPoint> points =
+      Render([](int, int c) { return (c < 8) ? 1.f : WALL; });
+
+  params.range_max = 1.5f;
+  std::vector<float> ranges = Scan(points, table, params);
+  for (int c = 0; c < WIDTH; ++c) {
+    if (c < 8) {
+      EXPECT_LT(ranges[Bin(table, c)], 1.5f);
+    } else {
+      EXPECT_EQ(ranges[Bin(table, c)], INF);
+    }
+  }
+
+  params.range_min = 1.5f;
+  params.range_max = 10.f;
+  ranges = Scan(points, table, params);
+  for (int c = 0; c < WIDTH; ++c) {
+    if (c < 8) {
+      EXPECT_EQ(ranges[Bin(table, c)], INF);
+    } else {
+      EXPECT_GE(ranges[Bin(table, c)], WALL);
+    }
+  }
+}
+
+TEST(Scan, InvalidPixelsAreSkipped) {
+  argus_ros::ScanParams params;
+  argus_ros::ScanTable table = Table(params);
+
+  // a close box in the band that the camera is unsure of, or masked out
+  std::vector<argus::DepthPoint> points =
+      Render([](int, int c) { return (c < 8) ? 1.f : WALL; });
+  for (int r = 0; r < HEIGHT; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      points[r * WIDTH + c].depthConfidence = 0;
+    }
+  }
+  argus_ros::PixelMask mask;
+  mask.words_per_row = 1;
+  mask.bits.assign(HEIGHT, 0);
+  for (int r = 0; r < HEIGHT; ++r) {
+    mask.bits[r] = 0xf0;  // columns 4 to 7
+  }
+  argus_ros::FrameInputs in = Inputs(points);
+  in.mask = &mask;
+
+  std::vector<float> ranges(table.nbins);
+  argus_ros::ProjectScan(in, table, params, ranges.data());
+  for (int c = 0; c < WIDTH; ++c) {
+    float r = ranges[Bin(table, c)];
+    if (c < 8) {
+      EXPECT_EQ(r, INF);
+    } else {
+      EXPECT_GE(r, WALL);
+    }
+  }
+}
+
+TEST(Scan, BandsMatchSerial) {
+  argus_ros::ScanParams params;
+  params.min_height = -0.3f;
+  params.max_height = 0.3f;
+  argus_ros::ScanTable table = Table(params);
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> depth(0.5f, 4.f);
+  std::vector<argus::DepthPoint> points =
+      Render([&](int, int) { return depth(rng); });
+  argus_ros::FrameInputs in = Inputs(points);
+  std::vector<float> serial = Scan(points, table, params);
+
+  for (int nbands : {1, 2, 3, 5, HEIGHT}) {
+    std::vector<float> sq(static_cast<std::size_t>(nbands) * table.nbins);
+    for (int b = 0; b < nbands; ++b) {
+      argus_ros::ScanRows(in, table, params, b * HEIGHT / nbands,
+                          (b + 1) * HEIGHT / nbands,
+                          sq.data() + b * table.nbins);
+    }
+    std::vector<float> ranges(table.nbins);
+    argus_ros::MergeScan(sq.data(), nbands, table.nbins, ranges.data());
+    for (int i = 0; i < table.nbins; ++i) {
+      EXPECT_EQ(ranges[i], serial[i]) << nbands << " bands, bin " << i;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Invalid pixels, whatever they hold, must neither change nor leak into
+// their neighbours.
+//
+
+#include <argus_ros/spatial_filter.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <argus.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+const float NaN_ = std::numeric_limits<float>::quiet_NaN();
+const float Inf_ = std::numeric_limits<float>::infinity();
+
+//
+// A noisy wall 2m away, with every `gap`-th pixel invalid: zero confidence
+// and NaN or infinite values, as the camera reports them
+//
+std::vector<argus::DepthPoint> Wall(int width, int height, int gap) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+
+  std::vector<argus::DepthPoint> points(width * height);
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    argus::DepthPoint& p = points[i];
+    p = argus::DepthPoint();
+    p.z = 2.f + jitter(rng);
+    p.x = 0.1f * p.z;
+    p.y = -0.1f * p.z;
+    p.noise = 0.005f;
+    p.depthConfidence = 255;
+    if (i % gap == 0) {
+      p.depthConfidence = 0;
+      p.z = (i % (2 * gap) == 0) ? NaN_ : Inf_;
+      p.x = NaN_;
+      p.y = NaN_;
+      p.noise = NaN_;
+    }
+  }
+  return points;
+}
+
+}  // end: anonymous namespace
+
+TEST(SpatialFilter, InvalidPixelsDoNotSpread) {
+  // odd sizes, so the rows and columns do not fill the blocks of four
+  const int width = 37;
+  const int height = 29;
+  argus_ros::SpatialParams params;
+  params.iterations = 3;
+
+  for (int gap : {2, 7, 32}) {
+    std::vector<argus::DepthPoint> points = Wall(width, height, gap);
+    argus_ros::SpatialFilter filter;
+    filter.Apply(params, points.data(), width, height);
+
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      const argus::DepthPoint& p = points[i];
+      if (i % gap == 0) {
+        EXPECT_TRUE(std::isnan(p.x)) << "pixel " << i << ", gap " << gap;
+        EXPECT_EQ(0, p.depthConfidence) << "pixel " << i << ", gap " << gap;
+        continue;
+      }
+      EXPECT_TRUE(std::isfinite(p.x) && std::isfinite(p.y) &&
+                  std::isfinite(p.z))
+          << "pixel " << i << ", gap " << gap;
+      EXPECT_NEAR(2.f, p.z, 0.01f) << "pixel " << i << ", gap " << gap;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
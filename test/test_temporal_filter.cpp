@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Each mode of the temporal filter against depths worked out by hand, on a
+// frame whose size does not fill the blocks of four.
+//
+
+#include <argus_ros/temporal_filter.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <gtest/gtest.h>
+
+namespace {
+const int WIDTH = 13;
+const int HEIGHT = 7;
+const float EPS = 1e-5f;
+
+//
+// Runs frames through one filter. Every pixel lies on the same ray, at
+// x = 0.1 z and y = -0.2 z.
+//
+class Frames {
+ public:
+  Frames() : points_(WIDTH * HEIGHT) {
+    this->in_.points = this->points_.data();
+    this->in_.width = WIDTH;
+    this->in_.height = HEIGHT;
+  }
+
+  argus_ros::TemporalParams params;
+
+  // the frame to be filtered next, all pixels at `z`
+  Frames& Next(float z, std::uint8_t conf = 255) {
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+      this->Set(i, z, conf);
+    }
+    return *this;
+  }
+
+  void Set(int i, float z, std::uint8_t conf = 255) {
+    argus::DepthPoint& p = this->points_[i];
+    p = argus::DepthPoint();
+    p.x = 0.1f * z;
+    p.y = -0.2f * z;
+    p.z = z;
+    p.noise = 0.005f;
+    p.depthConfidence = conf;
+  }
+
+  argus::DepthPoint& At(int i) { return this->points_[i]; }
+  argus_ros::FrameInputs& Inputs() { return this->in_; }
+
+  void Apply() {
+    this->filter_.Apply(this->params, this->in_, this->points_.data());
+  }
+
+  // every pixel filtered to `z`, still on its ray
+  void ExpectAll(float z) {
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+      ASSERT_NEAR(z, this->points_[i].z, EPS) << "pixel " << i;
+      ASSERT_NEAR(0.1f * z, this->points_[i].x, EPS) << "pixel " << i;
+      ASSERT_NEAR(-0.2f * z, this->points_[i].y, EPS) << "pixel " << i;
+    }
+  }
+
+ private:
+  std::vector<argus::DepthPoint> points_;
+  argus_ros::FrameInputs in_;
+  argus_ros::TemporalFilter filter_;
+};
+
+}  // end: anonymous namespace
+
+TEST(TemporalFilter, EMAConvergesOnAStaticScene) {
+  Frames f;
+  f.params.mode = argus_ros::TemporalMode::EMA;
+  f.params.alpha = 0.25f;
+
+  // the first frame passes through, then the estimate closes a quarter of
+  // the gap to the scene with every frame
+  f.Next(2.06f).Apply();
+  f.ExpectAll(2.06f);
+  float expected = 2.06f;
+  for (int k = 0; k < 40; ++k) {
+    f.Next(2.f).Apply();
+    expected += 0.25f * (2.f - expected);
+    f.ExpectAll(expected);
+  }
+  f.ExpectAll(2.f);
+}
+
+TEST(TemporalFilter, MedianRejectsAnOutlierFrame) {
+  Frames f;
+  f.params.mode = argus_ros::TemporalMode::MEDIAN;
+  f.params.history = 5;
+  f.params.max_jump = 1.f;
+
+  for (float z : {2.f, 2.02f, 1.98f}) {
+    f.Next(z).Apply();
+  }
+  f.ExpectAll(2.f);
+
+  // sorted 1.98, 2, 2.02, 2.5, the lower median is 2
+  f.Next(2.5f).Apply();
+  f.ExpectAll(2.f);
+  f.Next(2.01f).Apply();
+  f.ExpectAll(2.01f);
+}
+
+TEST(TemporalFilter, WeightedFavoursConfidentDepths) {
+  Frames f;
+  f.params.mode = argus_ros::TemporalMode::WEIGHTED;
+  f.params.history = 2;
+
+  f.Next(2.f, 200).Apply();
+  f.Next(2.06f, 50).Apply();
+  f.ExpectAll((200 * 2.f + 50 * 2.06f) / 250);
+
+  // the first frame has left the window
+  f.Next(2.03f, 150).Apply();
+  f.ExpectAll((50 * 2.06f + 150 * 2.03f) / 200);
+}
+
+TEST(TemporalFilter, ResetsWhenTheSceneMoves) {
+  // 3 of 7 rows jump by a meter, the others move by less than `max_jump`
+  const int moved = 3 * WIDTH;
+  for (float motion_fraction : {0.3f, 0.6f}) {
+    Frames f;
+    f.params.mode = argus_ros::TemporalMode::MEDIAN;
+    f.params.history = 4;
+    f.params.max_jump = 0.1f;
+    f.params.motion_fraction = motion_fraction;
+
+    for (int k = 0; k < 3; ++k) {
+      f.Next(2.f).Apply();
+    }
+    f.Next(2.04f);
+    for (int i = 0; i < moved; ++i) {
+      f.Set(i, 3.f);
+    }
+    f.Apply();
+
+    // the pixels that jumped restart either way
+    for (int i = 0; i < moved; ++i) {
+      ASSERT_NEAR(3.f, f.At(i).z, EPS) << "pixel " << i;
+    }
+
+    // 3/7 of the pixels moved: more than 0.3, the whole history is dropped;
+    // less than 0.6, the others keep their median of 2, 2, 2, 2.04
+    float rest = (motion_fraction < 3.f / 7) ? 2.04f : 2.f;
+    for (int i = moved; i < WIDTH * HEIGHT; ++i) {
+      ASSERT_NEAR(rest, f.At(i).z, EPS)
+          << "pixel " << i << ", motion fraction " << motion_fraction;
+    }
+  }
+}
+
+TEST(TemporalFilter, InvalidPixelsStayOut) {
+  const float inf = std::numeric_limits<float>::infinity();
+  Frames f;
+  f.params.mode = argus_ros::TemporalMode::EMA;
+  f.params.alpha = 0.5f;
+  f.params.max_jump = 1.f;
+
+  // mask out pixel 1 (stored transposed, see CompilePixelMask)
+  std::vector<float> mask(WIDTH * HEIGHT, 0.f);
+  mask[1 * HEIGHT + 0] = 1.f;
+  argus_ros::PixelMask pixel_mask =
+      argus_ros::CompilePixelMask(mask.data(), WIDTH, HEIGHT, HEIGHT, 0.5f);
+
+  argus_ros::FrameInputs& in = f.Inputs();
+  in.mask = &pixel_mask;
+  in.min_confidence = 10;
+  in.max_range = 4.f;
+  in.max_noise = 0.01f;
+
+  // below the confidence, masked, out of range, noisy, infinite, behind
+  const int gated[] = {0, 1, 2, 3, 4, 5};
+  const int first_valid = 6;
+  for (int k = 0; k < 3; ++k) {
+    float z = 2.f + 0.1f * k;
+    f.Next(z);
+    f.Set(0, z, 5);
+    f.Set(2, z + 2.5f);
+    f.At(3).noise = 0.02f;
+    f.Set(4, inf);
+    f.Set(5, -1.f);
+    f.Apply();
+
+    EXPECT_EQ(2.f + 0.1f * k, f.At(0).z);
+    EXPECT_EQ(2.f + 0.1f * k, f.At(1).z);
+    EXPECT_EQ(2.f + 0.1f * k + 2.5f, f.At(2).z);
+    EXPECT_EQ(2.f + 0.1f * k, f.At(3).z);
+    EXPECT_EQ(inf, f.At(4).z);
+    EXPECT_EQ(-1.f, f.At(5).z);
+  }
+
+  // the valid pixels saw 2, 2.1 and 2.2
+  const float expected = 0.5f * (0.5f * (2.f + 2.1f) + 2.2f);
+  for (int i = first_valid; i < WIDTH * HEIGHT; ++i) {
+    ASSERT_NEAR(expected, f.At(i).z, EPS) << "pixel " << i;
+  }
+
+  // once valid again, the gated pixels start over from their own depth
+  // instead of an estimate made of what was gated out
+  in.mask = nullptr;
+  f.Next(2.3f).Apply();
+  for (int i : gated) {
+    EXPECT_NEAR(2.3f, f.At(i).z, EPS) << "pixel " << i;
+  }
+  EXPECT_NEAR(0.5f * (expected + 2.3f), f.At(first_valid).z, EPS);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2017 Love Park Robotics, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distribted on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// The voxel grid against the sort-based reduction of the voxel benchmark, for
+// all three reductions, on a noisy scene and at the edges of the 21-bit voxel
+// coordinates. Once sized, reducing more frames must not touch the heap; the
+// global operator new is replaced to count allocations.
+//
+
+#include <argus_ros/voxel_grid.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <argus.hpp>
+#include <argus_ros/conversion.h>
+#include <gtest/gtest.h>
+
+namespace {
+std::atomic<bool> counting_(false);
+std::atomic<std::size_t> allocations_(0);
+
+}  // end: anonymous namespace
+
+void* operator new(std::size_t size) {
+  if (counting_.load(std::memory_order_relaxed)) {
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* ptr = std::malloc(size ? size : 1);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+using argus_ros::VoxelReduction;
+
+const int WIDTH = 64;
+const int HEIGHT = 48;
+const float BIAS = static_cast<float>(1 << 20);
+
+struct Point {
+  float x, y, z, intensity;
+};
+
+// a tilted wall with a box in front of it, noise and invalid pixels
+std::vector<argus::DepthPoint> MakeScene(int width, int height,
+                                         unsigned seed) {
+  std::vector<argus::DepthPoint> points(width * height);
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.f, 0.004f);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+  for (int r = 0; r < height; ++r) {
+    for (int c = 0; c < width; ++c) {
+      float u = (c - width / 2.f) / width;
+      float v = (r - height / 2.f) / height;
+      float z = 2.f + 0.8f * u;
+      if ((std::fabs(u) < 0.15f) && (std::fabs(v) < 0.2f)) {
+        z = 1.2f;
+      }
+      z += noise(rng);
+
+      argus::DepthPoint& p = points[r * width + c];
+      p = argus::DepthPoint();
+      p.x = u * z;
+      p.y = v * z;
+      p.z = z;
+      p.noise = 0.004f;
+      // few distinct values, so the max intensity has ties
+      p.grayValue = static_cast<std::uint16_t>(8.f * uniform(rng));
+      p.depthConfidence = (uniform(rng) > 0.05f) ? 255 : 0;
+    }
+  }
+  return points;
+}
+
+argus_ros::FrameInputs Inputs(const std::vector<argus::DepthPoint>& points,
+                              int width, int height) {
+  argus_ros::FrameInputs in;
+  in.points = points.data();
+  in.width = width;
+  in.height = height;
+  return in;
+}
+
+//
+// The voxel benchmark's SortReduce, extended by the nearest and max intensity
+// reductions: sorts (voxel key, pixel) pairs and reduces the runs of equal
+// keys, then orders the voxels by their first pixel as the grid emits them.
+//
+std::vector<Point> SortReduce(const argus_ros::FrameInputs& in,
+                              const argus_ros::VoxelParams& params) {
+  const float leaf = params.leaf_size;
+  const float inv_leaf = 1.f / leaf;
+
+  std::vector<std::pair<std::uint64_t, std::uint32_t> > pairs;
+  for (int r = 0; r < in.height; ++r) {
+    for (int c = 0; c < in.width; ++c) {
+      if (!argus_ros::IsValidPixel(in, r, c)) {
+        continue;
+      }
+      const argus::DepthPoint& p = in.points[r * in.width + c];
+      float f[3] = {std::floor(p.z * inv_leaf), std::floor(-p.x * inv_leaf),
+                    std::floor(-p.y * inv_leaf)};
+      if (!(std::fabs(f[0]) < BIAS) || !(std::fabs(f[1]) < BIAS) ||
+          !(std::fabs(f[2]) < BIAS)) {
+        continue;
+      }
+      std::uint64_t kx = static_cast<std::uint64_t>(f[0] + BIAS);
+      std::uint64_t ky = static_cast<std::uint64_t>(f[1] + BIAS);
+      std::uint64_t kz = static_cast<std::uint64_t>(f[2] + BIAS);
+      pairs.emplace_back((kx << 42) | (ky << 21) | kz,
+                         static_cast<std::uint32_t>(r * in.width + c));
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+
+  std::vector<std::pair<std::uint32_t, Point> > voxels;
+  for (std::size_t i = 0; i < pairs.size();) {
+    double sum[4] = {0., 0., 0., 0.};
+    Point best = {0.f, 0.f, 0.f, 0.f};
+    float best_score = std::numeric_limits<float>::infinity();
+    std::size_t j = i;
+    for (; (j < pairs.size()) && (pairs[j].first == pairs[i].first); ++j) {
+      const argus::DepthPoint& p = in.points[pairs[j].second];
+      Point pt = {p.z, -p.x, -p.y, static_cast<float>(p.grayValue)};
+      sum[0] += pt.x;
+      sum[1] += pt.y;
+      sum[2] += pt.z;
+      sum[3] += pt.intensity;
+
+      float score = -pt.intensity;
+      if (params.reduction == VoxelReduction::NEAREST) {
+        float dx = pt.x - (std::floor(pt.x * inv_leaf) * leaf + 0.5f * leaf);
+        float dy = pt.y - (std::floor(pt.y * inv_leaf) * leaf + 0.5f * leaf);
+        float dz = pt.z - (std::floor(pt.z * inv_leaf) * leaf + 0.5f * leaf);
+        score = dx * dx + dy * dy + dz * dz;
+      }
+      // pixels ascend within a run, the first of equal scores is kept
+      if (score < best_score) {
+        best = pt;
+        best_score = score;
+      }
+    }
+    if (params.reduction == VoxelReduction::CENTROID) {
+      double n = static_cast<double>(j - i);
+      best = {static_cast<float>(sum[0] / n), static_cast<float>(sum[1] / n),
+              static_cast<float>(sum[2] / n), static_cast<float>(sum[3] / n)};
+    }
+    voxels.emplace_back(pairs[i].second, best);
+    i = j;
+  }
+  std::sort(voxels.begin(), voxels.end(),
+            [](const std::pair<std::uint32_t, Point>& a,
+               const std::pair<std::uint32_t, Point>& b) {
+              return a.first < b.first;
+            });
+
+  std::vector<Point> out;
+  for (const auto& v : voxels) {
+    out.push_back(v.second);
+  }
+  return out;
+}
+
+std::vector<Point> Reduce(argus_ros::VoxelGrid& grid,
+                          const argus_ros::FrameInputs& in,
+                          const argus_ros::VoxelParams& params) {
+  std::vector<Point> out(static_cast<std::size_t>(in.width) * in.height);
+  std::size_t n = grid.Reduce(in, params,
+                              reinterpret_cast<std::uint8_t*>(out.data()));
+  out.resize(n);
+  return out;
+}
+
+// centroids are summed in float by the grid, in double by the oracle
+void ExpectSame(const std::vector<Point>& got,
+                const std::vector<Point>& want, VoxelReduction reduction) {
+  ASSERT_EQ(got.size(), want.size());
+  const float tol = (reduction == VoxelReduction::CENTROID) ? 1e-5f : 0.f;
+  for (std::size_t i = 0; i < got.size(); ++i) {
+    EXPECT_NEAR(got[i].x, want[i].x, tol * std::fabs(want[i].x)) << i;
+    EXPECT_NEAR(got[i].y, want[i].y, tol * std::fabs(want[i].y)) << i;
+    EXPECT_NEAR(got[i].z, want[i].z, tol * std::fabs(want[i].z)) << i;
+    EXPECT_NEAR(got[i].intensity, want[i].intensity,
+                tol * std::fabs(want[i].intensity) + tol)
+        << i;
+  }
+}
+
+const VoxelReduction REDUCTIONS[] = {VoxelReduction::CENTROID,
+                                     VoxelReduction::NEAREST,
+                                     VoxelReduction::MAX_INTENSITY};
+
+}  // end: anonymous namespace
+
+TEST(VoxelGrid, MatchesSortReduce) {
+  std::vector<argus::DepthPoint> points = MakeScene(WIDTH, HEIGHT, 1);
+  argus_ros::FrameInputs in = Inputs(points, WIDTH, HEIGHT);
+  argus_ros::VoxelGrid grid;
+
+  for (float leaf_size : {0.01f, 0.05f, 0.2f}) {
+    for (VoxelReduction reduction : REDUCTIONS) {
+      argus_ros::VoxelParams params;
+      params.leaf_size = leaf_size;
+      params.reduction = reduction;
+      std::vector<Point> want = SortReduce(in, params);
+      ASSERT_GT(want.size(), 1u);
+      ExpectSame(Reduce(grid, in, params), want, reduction);
+    }
+  }
+}
+
+TEST(VoxelGrid, KeyRangeEdges) {
+  // one-meter leaves, so the voxel coordinates are the floors of the points;
+  // -2^20 and 2^20 are out of the 21-bit range, the rest lands at its edges
+  const float lo = -BIAS + 1.5f;  // voxel -2^20 + 1
+  const float hi = BIAS - 0.5f;   // voxel 2^20 - 1
+  const Point sensor[] = {
+      {lo, 0.5f, 0.5f, 1.f},       {hi, 0.5f, 0.5f, 2.f},
+      {0.5f, lo, 0.5f, 3.f},       {0.5f, hi, 0.5f, 4.f},
+      {0.5f, 0.5f, lo, 5.f},       {0.5f, 0.5f, hi, 6.f},
+      {lo, lo, lo, 7.f},           {hi, hi, hi, 8.f},
+      {lo - 1.f, 0.5f, 0.5f, 9.f}, {hi + 1.f, 0.5f, 0.5f, 10.f},
+      {0.5f, 0.5f, lo - 1.f, 11.f}, {0.5f, hi + 1.f, 0.5f, 12.f},
+  };
+  const int n = sizeof(sensor) / sizeof(sensor[0]);
+
+  std::vector<argus::DepthPoint> points(n);
+  for (int i = 0; i < n; ++i) {
+    argus::DepthPoint& p = points[i];
+    p = argus::DepthPoint();
+    p.z = sensor[i].x;
+    p.x = -sensor[i].y;
+    p.y = -sensor[i].z;
+    p.grayValue = static_cast<std::uint16_t>(sensor[i].intensity);
+    p.depthConfidence = 255;
+  }
+  argus_ros::FrameInputs in = Inputs(points, n, 1);
+  in.min_range = -std::numeric_limits<float>::infinity();
+
+  argus_ros::VoxelGrid grid;
+  for (VoxelReduction reduction : REDUCTIONS) {
+    argus_ros::VoxelParams params;
+    params.leaf_size = 1.f;
+    params.reduction = reduction;
+    std::vector<Point> got = Reduce(grid, in, params);
+
+    // every point in range keeps a voxel of its own
+    ASSERT_EQ(got.size(), 8u);
+    for (int i = 0; i < 8; ++i) {
+      EXPECT_EQ(got[i].x, sensor[i].x);
+      EXPECT_EQ(got[i].y, sensor[i].y);
+      EXPECT_EQ(got[i].z, sensor[i].z);
+      EXPECT_EQ(got[i].intensity, sensor[i].intensity);
+    }
+    ExpectSame(got, SortReduce(in, params), reduction);
+  }
+}
+
+TEST(VoxelGrid, RepeatedFramesDoNotAllocate) {
+  std::vector<std::vector<argus::DepthPoint> > frames;
+  for (unsigned seed = 0; seed < 4; ++seed) {
+    frames.push_back(MakeScene(WIDTH, HEIGHT, seed));
+  }
+  std::vector<argus::DepthPoint> small = MakeScene(WIDTH / 2, HEIGHT / 2, 9);
+  std::vector<Point> out(WIDTH * HEIGHT);
+  std::uint8_t* dst = reinterpret_cast<std::uint8_t*>(out.data());
+
+  // sized by the first frame
+  argus_ros::VoxelGrid grid;
+  argus_ros::VoxelParams params;
+  grid.Reduce(Inputs(frames[0], WIDTH, HEIGHT), params, dst);
+
+  allocations_ = 0;
+  counting_ = true;
+  for (int pass = 0; pass < 3; ++pass) {
+    for (const std::vector<argus::DepthPoint>& frame : frames) {
+      for (VoxelReduction reduction : REDUCTIONS) {
+        for (float leaf_size : {0.01f, 0.05f, 0.2f}) {
+          params.leaf_size = leaf_size;
+          params.reduction = reduction;
+          grid.Reduce(Inputs(frame, WIDTH, HEIGHT), params, dst);
+        }
+      }
+      // a smaller ROI in between shrinks nothing the next frame regrows
+      grid.Reduce(Inputs(small, WIDTH / 2, HEIGHT / 2), params, dst);
+    }
+  }
+  counting_ = false;
+  EXPECT_EQ(allocations_, 0u);
+
+  // and the slots handed back leave no trace of the earlier frames
+  for (VoxelReduction reduction : REDUCTIONS) {
+    params.leaf_size = 0.05f;
+    params.reduction = reduction;
+    argus_ros::FrameInputs in = Inputs(frames[1], WIDTH, HEIGHT);
+    ExpectSame(Reduce(grid, in, params), SortReduce(in, params), reduction);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}